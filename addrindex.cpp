@@ -0,0 +1,430 @@
+#include "addrindex.h"
+
+#include <cerrno>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "standard.h"
+#include "common/endian.h"
+
+
+namespace satoshi {
+
+
+// All integers on disk are little-endian. The directory's slots come right
+// after its header, and the postings file's chunks right after its magic.
+
+struct AddressIndex::DirectoryHeader {
+	char magic[8];
+	le<uint64_t> salt;
+	le<uint64_t> n_slots, n_used; // a power of two, and at most half of it
+	le<uint64_t> postings_size; // as of the last complete flush
+	le<uint32_t> next_height;
+	le<uint32_t> reserved;
+};
+
+struct AddressIndex::DirectorySlot {
+	digest160_t hash;
+	le<uint32_t> n_chunks;
+	le<uint64_t> last_chunk; // zero while the slot is empty
+	le<uint64_t> n_entries;
+};
+
+// Followed by n_bytes of postings. Each is three varints: the height less the
+// previous posting's, the position in the block less the previous posting's
+// if the heights were the same but otherwise as it is, and the input or output
+// index shifted left once with the spent marker below it. The first posting is
+// taken to follow one at height 0 and position 0.
+struct AddressIndex::ChunkHeader {
+	le<uint64_t> prev; // the address's previous chunk, or zero
+	le<uint32_t> n_entries, n_bytes;
+	le<uint32_t> first_height, last_height;
+};
+
+static constexpr char directory_magic[8] = { 'A', 'D', 'D', 'R', 'I', 'D', 'X', '1' };
+static constexpr char postings_magic[8] = { 'A', 'D', 'D', 'R', 'D', 'A', 'T', '1' };
+static constexpr size_t min_slots = 1024;
+
+static void _noreturn throw_errno(const char *what) {
+	throw std::ios_base::failure(what, std::error_code(errno, std::system_category()));
+}
+
+static void _noreturn throw_corrupt() {
+	throw std::ios_base::failure("address index is corrupt");
+}
+
+static void * map_file(int fd, size_t size, int prot) {
+	void *p = ::mmap(nullptr, size, prot, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) {
+		throw_errno("mmap");
+	}
+	return p;
+}
+
+static void append_varint(std::vector<uint8_t> &bytes, uint64_t n) {
+	for (; n >= 0x80; n >>= 7) {
+		bytes.push_back(static_cast<uint8_t>(n | 0x80));
+	}
+	bytes.push_back(static_cast<uint8_t>(n));
+}
+
+static const uint8_t * read_varint(const uint8_t *p, const uint8_t *end, uint64_t &n) {
+	n = 0;
+	for (unsigned shift = 0; p < end && shift < 64; shift += 7) {
+		uint8_t b = *p++;
+		n |= uint64_t(b & 0x7F) << shift;
+		if (b < 0x80) {
+			return p;
+		}
+	}
+	throw_corrupt();
+}
+
+static void decode_postings(std::vector<AddressPosting> &out, const uint8_t *p, const uint8_t *end, uint32_t n_entries, uint32_t min_height) {
+	uint64_t height = 0, tx = 0;
+	while (n_entries-- > 0) {
+		uint64_t height_delta, tx_delta, index;
+		p = read_varint(p, end, height_delta);
+		p = read_varint(p, end, tx_delta);
+		p = read_varint(p, end, index);
+		height += height_delta, tx = height_delta == 0 ? tx + tx_delta : tx_delta;
+		if (height >= min_height) {
+			out.push_back({ static_cast<uint32_t>(height), static_cast<uint32_t>(tx), static_cast<uint32_t>(index >> 1), (index & 1) != 0 });
+		}
+	}
+}
+
+
+AddressIndex::AddressIndex(const std::string &path) : path(path), dir_fd(-1), postings_fd(-1), dir(), dir_size(), postings(), postings_mapped(), next_height(), pending(0, DigestHash(std::random_device()())) {
+	try {
+		this->open();
+	}
+	catch (...) {
+		this->close();
+		throw;
+	}
+}
+
+AddressIndex::~AddressIndex() {
+	this->close();
+}
+
+void AddressIndex::add_block(const BlockMessage &block, uint32_t height, const CoinView &coins) {
+	if (height < next_height) {
+		throw std::invalid_argument("block is not after those already indexed");
+	}
+	// as in BlockValidator::validate(), outputs created earlier in the same
+	// block are spendable; txids are hashed with the salt of the pending map
+	std::unordered_map<digest256_t, size_t, DigestHash> block_txns(block.txns.size(), pending.hash_function());
+	Address address;
+	for (size_t tx_idx = 0; tx_idx < block.txns.size(); ++tx_idx) {
+		auto &tx = block.txns[tx_idx];
+		for (size_t input = 0; tx_idx > 0 && input < tx.inputs.size(); ++input) {
+			auto &prevout = tx.inputs[input].prevout;
+			const TxOut *txout = nullptr;
+			auto itr = block_txns.find(prevout.tx_hash);
+			if (itr != block_txns.end()) {
+				auto &outputs = block.txns[itr->second].outputs;
+				if (prevout.txout_idx < outputs.size()) {
+					txout = &outputs[prevout.txout_idx];
+				}
+			}
+			else {
+				txout = coins.find(prevout);
+			}
+			if (txout && match_to_address(address, classify_script(txout->script))) {
+				this->add_posting(address.hash, height, static_cast<uint32_t>(tx_idx), static_cast<uint32_t>(input), true);
+			}
+		}
+		for (size_t output = 0; output < tx.outputs.size(); ++output) {
+			if (match_to_address(address, classify_script(tx.outputs[output].script))) {
+				this->add_posting(address.hash, height, static_cast<uint32_t>(tx_idx), static_cast<uint32_t>(output), false);
+			}
+		}
+		if (tx_idx + 1 < block.txns.size()) {
+			block_txns.emplace(tx_hash(tx), tx_idx);
+		}
+	}
+	next_height = height + 1;
+}
+
+void AddressIndex::flush() {
+	if (pending.empty() && next_height == dir->next_height) {
+		return;
+	}
+	size_t n_new = 0;
+	for (auto &entry : pending) {
+		n_new += !this->find_slot(entry.first, false);
+	}
+	if ((dir->n_used + n_new) * 2 > dir->n_slots) {
+		this->grow_directory(dir->n_used + n_new);
+	}
+	// every chunk goes out in one write, and the directory is only changed
+	// once they are all on disk
+	std::vector<uint8_t> bytes;
+	std::vector<uint64_t> chunks;
+	chunks.reserve(pending.size());
+	uint64_t end = dir->postings_size;
+	for (auto &entry : pending) {
+		auto slot = this->find_slot(entry.first, false);
+		auto &p = entry.second;
+		ChunkHeader hdr;
+		hdr.prev = slot ? uint64_t(slot->last_chunk) : 0;
+		hdr.n_entries = p.n_entries, hdr.n_bytes = static_cast<uint32_t>(p.bytes.size());
+		hdr.first_height = p.first_height, hdr.last_height = p.last_height;
+		chunks.push_back(end + bytes.size());
+		auto hdr_bytes = reinterpret_cast<const uint8_t *>(&hdr);
+		bytes.insert(bytes.end(), hdr_bytes, hdr_bytes + sizeof hdr);
+		bytes.insert(bytes.end(), p.bytes.begin(), p.bytes.end());
+	}
+	for (size_t done = 0; done < bytes.size();) {
+		ssize_t n = ::pwrite(postings_fd, bytes.data() + done, bytes.size() - done, end + done);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			throw_errno("pwrite");
+		}
+		done += n;
+	}
+	if (::fdatasync(postings_fd) < 0) {
+		throw_errno("fdatasync");
+	}
+	auto chunk = chunks.begin();
+	for (auto &entry : pending) {
+		auto slot = this->find_slot(entry.first, true);
+		slot->last_chunk = *chunk++;
+		slot->n_chunks = slot->n_chunks + 1;
+		slot->n_entries = slot->n_entries + entry.second.n_entries;
+	}
+	dir->n_used = dir->n_used + n_new;
+	dir->postings_size = end + bytes.size();
+	dir->next_height = next_height;
+	if (::msync(dir, dir_size, MS_SYNC) < 0) {
+		throw_errno("msync");
+	}
+	pending.clear();
+	this->map_postings();
+}
+
+uint64_t AddressIndex::count(const digest160_t &hash) const {
+	uint64_t n = 0;
+	if (auto slot = this->find_slot(hash, false)) {
+		n += slot->n_entries;
+	}
+	auto itr = pending.find(hash);
+	if (itr != pending.end()) {
+		n += itr->second.n_entries;
+	}
+	return n;
+}
+
+void AddressIndex::history(std::vector<AddressPosting> &out, const digest160_t &hash, uint32_t min_height) const {
+	if (auto slot = this->find_slot(hash, false)) {
+		// gather the chunks that reach min_height, then decode them oldest first
+		std::vector<uint64_t> chunks;
+		ChunkHeader hdr;
+		for (uint64_t chunk = slot->last_chunk; chunk != 0; chunk = hdr.prev) {
+			if (chunk < sizeof postings_magic || chunk >= postings_mapped || postings_mapped - chunk < sizeof hdr) {
+				throw_corrupt();
+			}
+			std::memcpy(&hdr, postings + chunk, sizeof hdr);
+			if (hdr.n_bytes > postings_mapped - chunk - sizeof hdr || hdr.prev >= chunk) {
+				throw_corrupt();
+			}
+			if (hdr.last_height < min_height) {
+				break;
+			}
+			chunks.push_back(chunk);
+		}
+		for (auto itr = chunks.rbegin(); itr != chunks.rend(); ++itr) {
+			std::memcpy(&hdr, postings + *itr, sizeof hdr);
+			auto bytes = postings + *itr + sizeof hdr;
+			decode_postings(out, bytes, bytes + hdr.n_bytes, hdr.n_entries, min_height);
+		}
+	}
+	auto itr = pending.find(hash);
+	if (itr != pending.end()) {
+		auto &p = itr->second;
+		decode_postings(out, p.bytes.data(), p.bytes.data() + p.bytes.size(), p.n_entries, min_height);
+	}
+}
+
+void AddressIndex::open() {
+	static_assert(sizeof(DirectoryHeader) == 48 && sizeof(DirectorySlot) == 40 && sizeof(ChunkHeader) == 24, "padding in the on-disk structures");
+	auto dir_path = path + ".idx", postings_path = path + ".dat";
+	if ((dir_fd = ::open(dir_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0) {
+		throw_errno("open");
+	}
+	struct stat st;
+	if (::fstat(dir_fd, &st) < 0) {
+		throw_errno("fstat");
+	}
+	if (st.st_size == 0) {
+		dir_size = sizeof(DirectoryHeader) + min_slots * sizeof(DirectorySlot);
+		if (::ftruncate(dir_fd, dir_size) < 0) {
+			throw_errno("ftruncate");
+		}
+		dir = static_cast<DirectoryHeader *>(map_file(dir_fd, dir_size, PROT_READ | PROT_WRITE));
+		std::memcpy(dir->magic, directory_magic, sizeof dir->magic);
+		std::random_device rd;
+		dir->salt = uint64_t(rd()) << 32 | rd();
+		dir->n_slots = min_slots;
+		dir->postings_size = sizeof postings_magic;
+	}
+	else {
+		dir_size = st.st_size;
+		if (dir_size < sizeof(DirectoryHeader)) {
+			throw_corrupt();
+		}
+		dir = static_cast<DirectoryHeader *>(map_file(dir_fd, dir_size, PROT_READ | PROT_WRITE));
+		uint64_t n_slots = dir->n_slots;
+		if (std::memcmp(dir->magic, directory_magic, sizeof dir->magic) != 0 || n_slots == 0 || (n_slots & n_slots - 1) != 0 ||
+				n_slots != (dir_size - sizeof(DirectoryHeader)) / sizeof(DirectorySlot) || dir->n_used * 2 > n_slots) {
+			throw_corrupt();
+		}
+	}
+	if ((postings_fd = ::open(postings_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0) {
+		throw_errno("open");
+	}
+	if (::fstat(postings_fd, &st) < 0) {
+		throw_errno("fstat");
+	}
+	if (st.st_size == 0 && dir->postings_size == sizeof postings_magic) {
+		if (::pwrite(postings_fd, postings_magic, sizeof postings_magic, 0) != sizeof postings_magic) {
+			throw_errno("pwrite");
+		}
+	}
+	else if (static_cast<uint64_t>(st.st_size) < dir->postings_size) {
+		throw_corrupt();
+	}
+	// drop whatever an unfinished flush appended
+	else if (static_cast<uint64_t>(st.st_size) > dir->postings_size && ::ftruncate(postings_fd, dir->postings_size) < 0) {
+		throw_errno("ftruncate");
+	}
+	this->map_postings();
+	if (std::memcmp(postings, postings_magic, sizeof postings_magic) != 0) {
+		throw_corrupt();
+	}
+	next_height = dir->next_height;
+}
+
+void AddressIndex::close() {
+	if (postings) {
+		::munmap(const_cast<uint8_t *>(postings), postings_mapped);
+	}
+	if (dir) {
+		::munmap(dir, dir_size);
+	}
+	if (postings_fd >= 0) {
+		::close(postings_fd);
+	}
+	if (dir_fd >= 0) {
+		::close(dir_fd);
+	}
+}
+
+void AddressIndex::add_posting(const digest160_t &hash, uint32_t height, uint32_t tx, uint32_t index, bool spent) {
+	auto &p = pending[hash];
+	if (p.n_entries == 0) {
+		p.first_height = height;
+	}
+	uint32_t height_delta = height - p.last_height;
+	append_varint(p.bytes, height_delta);
+	append_varint(p.bytes, height_delta == 0 ? tx - p.last_tx : tx);
+	append_varint(p.bytes, uint64_t(index) << 1 | spent);
+	p.last_height = height, p.last_tx = tx, ++p.n_entries;
+}
+
+AddressIndex::DirectorySlot * AddressIndex::slots() const {
+	return reinterpret_cast<DirectorySlot *>(dir + 1);
+}
+
+AddressIndex::DirectorySlot * AddressIndex::find_slot(const digest160_t &hash, bool insert) const {
+	size_t mask = dir->n_slots - 1;
+	auto slots = this->slots();
+	// linear probing, which ends because the table is never more than half full
+	for (size_t i = DigestHash(dir->salt)(hash) & mask;; i = i + 1 & mask) {
+		auto &slot = slots[i];
+		if (slot.last_chunk == 0) {
+			if (!insert) {
+				return nullptr;
+			}
+			slot.hash = hash;
+			return &slot;
+		}
+		if (slot.hash == hash) {
+			return &slot;
+		}
+	}
+}
+
+void AddressIndex::grow_directory(size_t n_used) {
+	size_t n_slots = dir->n_slots;
+	while (n_used * 2 > n_slots) {
+		n_slots *= 2;
+	}
+	// the larger table is built aside and then renamed over the old one
+	auto tmp_path = path + ".idx.tmp";
+	int fd = ::open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		throw_errno("open");
+	}
+	size_t size = sizeof(DirectoryHeader) + n_slots * sizeof(DirectorySlot);
+	DirectoryHeader *grown = nullptr;
+	try {
+		if (::ftruncate(fd, size) < 0) {
+			throw_errno("ftruncate");
+		}
+		grown = static_cast<DirectoryHeader *>(map_file(fd, size, PROT_READ | PROT_WRITE));
+		std::memcpy(grown, dir, sizeof *dir);
+		grown->n_slots = n_slots;
+		auto old_slots = this->slots(), new_slots = reinterpret_cast<DirectorySlot *>(grown + 1);
+		DigestHash hasher(dir->salt);
+		for (size_t i = 0; i < dir->n_slots; ++i) {
+			if (old_slots[i].last_chunk != 0) {
+				size_t j = hasher(old_slots[i].hash) & n_slots - 1;
+				while (new_slots[j].last_chunk != 0) {
+					j = j + 1 & n_slots - 1;
+				}
+				new_slots[j] = old_slots[i];
+			}
+		}
+		if (::msync(grown, size, MS_SYNC) < 0) {
+			throw_errno("msync");
+		}
+		if (::rename(tmp_path.c_str(), (path + ".idx").c_str()) < 0) {
+			throw_errno("rename");
+		}
+	}
+	catch (...) {
+		if (grown) {
+			::munmap(grown, size);
+		}
+		::close(fd);
+		::unlink(tmp_path.c_str());
+		throw;
+	}
+	::munmap(dir, dir_size);
+	::close(dir_fd);
+	dir = grown, dir_size = size, dir_fd = fd;
+}
+
+void AddressIndex::map_postings() {
+	if (postings) {
+		::munmap(const_cast<uint8_t *>(postings), postings_mapped);
+		postings = nullptr;
+	}
+	postings_mapped = dir->postings_size;
+	postings = static_cast<const uint8_t *>(map_file(postings_fd, postings_mapped, PROT_READ));
+}
+
+
+} // namespace satoshi
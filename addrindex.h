@@ -0,0 +1,90 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "validation.h"
+
+
+namespace satoshi {
+
+
+struct AddressPosting {
+	uint32_t height;
+	uint32_t tx; // position in the block
+	uint32_t index; // of the output, or of the input for a spend
+	bool spent; // a spend of one of the address's outputs
+};
+
+
+// On-disk index from the hash of each P2PKH and P2SH address to every output
+// paying it and every input spending one of those, built as blocks are added
+// in chain order. Postings are kept in memory until flush() appends them to
+// path.dat, as one chunk per address. Each chunk is delta-encoded on its own
+// and links back to the address's previous chunk. The directory in path.idx
+// is an open-addressed table, mapped into memory, that holds each address's
+// newest chunk and number of postings. A query reads only the chunks of its
+// own address, newest first, and stops at the first chunk before the height
+// asked for. Queries see postings not yet flushed. They may run side by side,
+// but not alongside add_block() or flush(). The index must be rebuilt if the
+// process dies during flush().
+class AddressIndex {
+
+private:
+	struct DirectoryHeader;
+	struct DirectorySlot;
+	struct ChunkHeader;
+
+	struct Pending {
+		std::vector<uint8_t> bytes; // encoded as in a chunk
+		uint32_t n_entries, first_height, last_height, last_tx;
+	};
+
+private:
+	std::string path;
+	int dir_fd, postings_fd;
+	DirectoryHeader *dir;
+	size_t dir_size;
+	const uint8_t *postings; // the flushed postings file, mapped
+	size_t postings_mapped;
+	uint32_t next_height;
+	std::unordered_map<digest160_t, Pending, DigestHash> pending;
+
+public:
+	// Opens the index at path.idx and path.dat, creating it if there is none.
+	explicit AddressIndex(const std::string &path);
+	~AddressIndex();
+
+	AddressIndex(const AddressIndex &) = delete;
+	AddressIndex & operator = (const AddressIndex &) = delete;
+
+public:
+	// one past the last block added
+	uint32_t height() const { return next_height; }
+
+	// The outputs that the block spends must be in coins unless the block
+	// itself creates them. Throws std::invalid_argument if the block is not
+	// after those already added.
+	void add_block(const BlockMessage &block, uint32_t height, const CoinView &coins);
+	void flush();
+
+	uint64_t count(const digest160_t &hash) const;
+	uint64_t count(const Address &address) const { return this->count(address.hash); }
+	// Appends the postings at or after min_height in chain order.
+	void history(std::vector<AddressPosting> &out, const digest160_t &hash, uint32_t min_height = 0) const;
+	void history(std::vector<AddressPosting> &out, const Address &address, uint32_t min_height = 0) const { this->history(out, address.hash, min_height); }
+
+private:
+	void open();
+	void close();
+	void add_posting(const digest160_t &hash, uint32_t height, uint32_t tx, uint32_t index, bool spent);
+	DirectorySlot * slots() const;
+	DirectorySlot * find_slot(const digest160_t &hash, bool insert) const;
+	void grow_directory(size_t n_used);
+	void map_postings();
+
+};
+
+
+} // namespace satoshi
@@ -0,0 +1,56 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+
+namespace satoshi {
+
+
+constexpr size_t Arena::default_chunk_size;
+constexpr size_t Arena::max_chunk_size;
+constexpr size_t Arena::max_reserve;
+
+void Arena::reset() {
+	if (head) {
+		for (Chunk *chunk = head->next, *next; chunk; chunk = next) {
+			next = chunk->next;
+			total -= chunk->size;
+			std::free(chunk);
+		}
+		head->next = nullptr;
+		ptr = reinterpret_cast<uintptr_t>(head + 1);
+	}
+}
+
+void Arena::release() {
+	for (Chunk *chunk = head, *next; chunk; chunk = next) {
+		next = chunk->next;
+		std::free(chunk);
+	}
+	head = nullptr;
+	ptr = end = 0;
+	total = 0;
+}
+
+void * Arena::allocate_chunk(size_t size, size_t align) {
+	size_t header = sizeof(Chunk) + align - 1;
+	if (size > SIZE_MAX - header) {
+		throw std::bad_alloc();
+	}
+	size_t chunk_size = std::max(next_size, header + size);
+	auto chunk = static_cast<Chunk *>(std::malloc(chunk_size));
+	if (!chunk) {
+		throw std::bad_alloc();
+	}
+	chunk->next = head, chunk->size = chunk_size;
+	head = chunk;
+	total += chunk_size;
+	next_size = std::min(next_size * 2, max_chunk_size);
+	ptr = reinterpret_cast<uintptr_t>(chunk + 1);
+	end = reinterpret_cast<uintptr_t>(chunk) + chunk_size;
+	return this->allocate(size, align);
+}
+
+
+} // namespace satoshi
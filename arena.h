@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include "common/compiler.h"
+
+
+namespace satoshi {
+
+
+// Monotonic allocator: memory is handed out from large chunks and is only
+// returned to the heap all at once. Anything allocated from an arena must not
+// outlive it.
+class Arena {
+
+public:
+	static constexpr size_t default_chunk_size = size_t(1) << 16;
+	static constexpr size_t max_chunk_size = size_t(1) << 24;
+	static constexpr size_t max_reserve = 4096; // elements to reserve for an untrusted count
+
+private:
+	struct Chunk {
+		Chunk *next;
+		size_t size;
+	};
+
+private:
+	Chunk *head;
+	uintptr_t ptr, end;
+	size_t next_size, total;
+
+public:
+	explicit Arena(size_t chunk_size = default_chunk_size) : head(), ptr(), end(), next_size(chunk_size), total() { }
+	~Arena() { this->release(); }
+
+	Arena(const Arena &) = delete;
+	Arena & operator = (const Arena &) = delete;
+
+public:
+	void * allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+		uintptr_t p = ptr + align - 1 & ~static_cast<uintptr_t>(align - 1);
+		if (p < ptr || p > end || size > end - p) {
+			return this->allocate_chunk(size, align);
+		}
+		ptr = p + size;
+		return reinterpret_cast<void *>(p);
+	}
+
+	// bytes obtained from the heap, including chunk headers and unused tails
+	size_t size_reserved() const { return total; }
+
+	// Frees every chunk but the most recent, which is kept for reuse.
+	void reset();
+
+	// Frees every chunk.
+	void release();
+
+private:
+	void * allocate_chunk(size_t size, size_t align);
+
+};
+
+
+template <typename T>
+class ArenaAllocator {
+	template <typename U> friend class ArenaAllocator;
+
+public:
+	typedef T value_type;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+
+private:
+	Arena *arena;
+
+public:
+	// a null arena allocates from the heap like std::allocator
+	ArenaAllocator(Arena *arena = nullptr) noexcept : arena(arena) { }
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U> &other) noexcept : arena(other.arena) { }
+
+public:
+	Arena * get_arena() const { return arena; }
+
+	T * allocate(size_t n) {
+		if (arena) {
+			if (n > SIZE_MAX / sizeof(T)) {
+				throw std::bad_alloc();
+			}
+			return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T)));
+		}
+		return std::allocator<T>().allocate(n);
+	}
+
+	void deallocate(T *p, size_t n) {
+		if (!arena) {
+			std::allocator<T>().deallocate(p, n);
+		}
+	}
+
+	// copies of arena-backed containers are independent heap-backed containers
+	ArenaAllocator select_on_container_copy_construction() const { return ArenaAllocator(); }
+
+	template <typename U>
+	bool operator == (const ArenaAllocator<U> &rhs) const { return arena == rhs.arena; }
+	template <typename U>
+	bool operator != (const ArenaAllocator<U> &rhs) const { return arena != rhs.arena; }
+
+};
+
+
+template <typename T>
+struct _in_arena {
+	T &value;
+	Arena &arena;
+};
+
+// Deserializes into arena-backed storage: source >> in_arena(msg, arena)
+// The target must not still hold storage from an arena: clear, reassign or
+// destroy it before that arena's reset() or release(), as destroying or reusing
+// that storage afterwards touches freed memory. Deserializing throws
+// std::invalid_argument if it does. A cleared Script keeps its buffer.
+template <typename T>
+static inline _in_arena<T> in_arena(T &value, Arena &arena) { return { value, arena }; }
+
+template <typename T>
+static inline bool holds_arena_elements(const std::vector<T, ArenaAllocator<T>> &v) { return !v.empty() && v.get_allocator().get_arena(); }
+
+
+} // namespace satoshi
@@ -0,0 +1,209 @@
+#include "base16.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include "lanes.h"
+
+
+static constexpr char encode[16] = {
+	'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'
+};
+
+static int decode_digit(char c) {
+	if (static_cast<unsigned>(c - '0') < 10) {
+		return c - '0';
+	}
+	c |= 0x20;
+	return static_cast<unsigned>(c - 'a') < 6 ? c - 'a' + 10 : -1;
+}
+
+
+// vector code, as lanes.h describes
+static _lane_inline void reverse(Bytes16 &x) {
+	x = __builtin_shuffle(x, Bytes16 { 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0 });
+}
+
+static _lane_inline void reverse(Bytes32 &x) {
+	x = __builtin_shuffle(x, Bytes32 {
+		31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17, 16,
+		15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0
+	});
+}
+
+// the first and second halves of x and y interleaved
+static _lane_inline void interleave(Bytes16 &lo, Bytes16 &hi, const Bytes16 &x, const Bytes16 &y) {
+	lo = __builtin_shuffle(x, y, Bytes16 { 0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23 });
+	hi = __builtin_shuffle(x, y, Bytes16 { 8, 24, 9, 25, 10, 26, 11, 27, 12, 28, 13, 29, 14, 30, 15, 31 });
+}
+
+static _lane_inline void interleave(Bytes32 &lo, Bytes32 &hi, const Bytes32 &x, const Bytes32 &y) {
+	lo = __builtin_shuffle(x, y, Bytes32 {
+		0, 32, 1, 33, 2, 34, 3, 35, 4, 36, 5, 37, 6, 38, 7, 39,
+		8, 40, 9, 41, 10, 42, 11, 43, 12, 44, 13, 45, 14, 46, 15, 47
+	});
+	hi = __builtin_shuffle(x, y, Bytes32 {
+		16, 48, 17, 49, 18, 50, 19, 51, 20, 52, 21, 53, 22, 54, 23, 55,
+		24, 56, 25, 57, 26, 58, 27, 59, 28, 60, 29, 61, 30, 62, 31, 63
+	});
+}
+
+// the even- and odd-indexed elements of x followed by those of y
+static _lane_inline void deinterleave(Bytes16 &even, Bytes16 &odd, const Bytes16 &x, const Bytes16 &y) {
+	even = __builtin_shuffle(x, y, Bytes16 { 0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30 });
+	odd = __builtin_shuffle(x, y, Bytes16 { 1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31 });
+}
+
+static _lane_inline void deinterleave(Bytes32 &even, Bytes32 &odd, const Bytes32 &x, const Bytes32 &y) {
+	even = __builtin_shuffle(x, y, Bytes32 {
+		0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30,
+		32, 34, 36, 38, 40, 42, 44, 46, 48, 50, 52, 54, 56, 58, 60, 62
+	});
+	odd = __builtin_shuffle(x, y, Bytes32 {
+		1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31,
+		33, 35, 37, 39, 41, 43, 45, 47, 49, 51, 53, 55, 57, 59, 61, 63
+	});
+}
+
+// nibble values to their digits
+template <typename V>
+static _lane_inline void to_ascii(V &x) {
+	x = x + '0' + (reinterpret_cast<V>(x > 9) & ('a' - '0' - 10));
+}
+
+// digits to their nibble values, setting the bytes of `invalid` wherever x is
+// not a hex digit
+template <typename V>
+static _lane_inline void from_ascii(V &x, V &invalid) {
+	V d = x - '0', l = (x | 0x20) - 'a';
+	V is_d = reinterpret_cast<V>(d < 10), is_l = reinterpret_cast<V>(l < 6);
+	invalid |= ~(is_d | is_l);
+	x = (d & is_d) | ((l + 10) & is_l);
+}
+
+// encodes whole vectors' worth and returns how many bytes it encoded
+template <typename V, bool reversed>
+static _lane_inline size_t encode_vectors(char * _restrict out, const uint8_t * _restrict in, size_t n) {
+	size_t i = 0;
+	for (; i + sizeof(V) <= n; i += sizeof(V)) {
+		V x, lo, hi;
+		std::memcpy(&x, reversed ? in + n - i - sizeof(V) : in + i, sizeof x);
+		if (reversed) {
+			reverse(x);
+		}
+		interleave(lo, hi, x >> 4, x & 0xF);
+		to_ascii(lo), to_ascii(hi);
+		std::memcpy(out + i * 2, &lo, sizeof lo);
+		std::memcpy(out + i * 2 + sizeof(V), &hi, sizeof hi);
+	}
+	return i;
+}
+
+// decodes whole vectors' worth and returns how many bytes it decoded, or
+// returns -1 if it met any char that is not a hex digit
+template <typename V, bool reversed>
+static _lane_inline ptrdiff_t decode_vectors(uint8_t * _restrict out, const char * _restrict in, size_t n) {
+	V invalid = { };
+	size_t i = 0;
+	for (; i + sizeof(V) <= n; i += sizeof(V)) {
+		V c0, c1, hi, lo;
+		std::memcpy(&c0, in + i * 2, sizeof c0);
+		std::memcpy(&c1, in + i * 2 + sizeof(V), sizeof c1);
+		from_ascii(c0, invalid), from_ascii(c1, invalid);
+		deinterleave(hi, lo, c0, c1);
+		V x = hi << 4 | lo;
+		if (reversed) {
+			reverse(x);
+		}
+		std::memcpy(reversed ? out + n - i - sizeof(V) : out + i, &x, sizeof x);
+	}
+	uint64_t words[sizeof(V) / 8], any = 0;
+	std::memcpy(words, &invalid, sizeof words);
+	for (auto word : words) {
+		any |= word;
+	}
+	return any ? -1 : static_cast<ptrdiff_t>(i);
+}
+
+#ifdef LANES_X86
+
+__attribute__((__target__("avx2")))
+static size_t encode_avx2(char * _restrict out, const uint8_t * _restrict in, size_t n, bool reversed) {
+	return reversed ? encode_vectors<Bytes32, true>(out, in, n) : encode_vectors<Bytes32, false>(out, in, n);
+}
+
+__attribute__((__target__("avx2")))
+static ptrdiff_t decode_avx2(uint8_t * _restrict out, const char * _restrict in, size_t n, bool reversed) {
+	return reversed ? decode_vectors<Bytes32, true>(out, in, n) : decode_vectors<Bytes32, false>(out, in, n);
+}
+
+__attribute__((__target__("ssse3")))
+static size_t encode_ssse3(char * _restrict out, const uint8_t * _restrict in, size_t n, bool reversed) {
+	return reversed ? encode_vectors<Bytes16, true>(out, in, n) : encode_vectors<Bytes16, false>(out, in, n);
+}
+
+__attribute__((__target__("ssse3")))
+static ptrdiff_t decode_ssse3(uint8_t * _restrict out, const char * _restrict in, size_t n, bool reversed) {
+	return reversed ? decode_vectors<Bytes16, true>(out, in, n) : decode_vectors<Bytes16, false>(out, in, n);
+}
+
+#endif
+
+static size_t encode_generic(char * _restrict out, const uint8_t * _restrict in, size_t n, bool reversed) {
+	return reversed ? encode_vectors<Bytes16, true>(out, in, n) : encode_vectors<Bytes16, false>(out, in, n);
+}
+
+static ptrdiff_t decode_generic(uint8_t * _restrict out, const char * _restrict in, size_t n, bool reversed) {
+	return reversed ? decode_vectors<Bytes16, true>(out, in, n) : decode_vectors<Bytes16, false>(out, in, n);
+}
+
+static void encode_simd(char * _restrict out, const void * _restrict in, size_t n, bool reversed) {
+#ifdef LANES_X86
+	static const auto vectors = select_lanes(&encode_generic, &encode_ssse3, &encode_avx2, nullptr);
+#else
+	static const auto vectors = &encode_generic;
+#endif
+	auto bytes = static_cast<const uint8_t *>(in);
+	for (size_t i = n < 16 ? 0 : vectors(out, bytes, n, reversed); i < n; ++i) {
+		uint8_t b = reversed ? bytes[n - 1 - i] : bytes[i];
+		out[i * 2] = encode[b >> 4], out[i * 2 + 1] = encode[b & 0xF];
+	}
+}
+
+static bool decode_simd(void * _restrict out, const char * _restrict in, size_t n, bool reversed) {
+#ifdef LANES_X86
+	static const auto vectors = select_lanes(&decode_generic, &decode_ssse3, &decode_avx2, nullptr);
+#else
+	static const auto vectors = &decode_generic;
+#endif
+	auto bytes = static_cast<uint8_t *>(out);
+	ptrdiff_t done = n < 16 ? 0 : vectors(bytes, in, n, reversed);
+	if (done < 0) {
+		return false;
+	}
+	for (size_t i = done; i < n; ++i) {
+		int hi = decode_digit(in[i * 2]), lo = decode_digit(in[i * 2 + 1]);
+		if ((hi | lo) < 0) {
+			return false;
+		}
+		(reversed ? bytes[n - 1 - i] : bytes[i]) = static_cast<uint8_t>(hi << 4 | lo);
+	}
+	return true;
+}
+
+
+void base16_encode(char * _restrict out, const void * _restrict in, size_t n) {
+	encode_simd(out, in, n, false);
+}
+
+void base16_encode_reversed(char * _restrict out, const void * _restrict in, size_t n) {
+	encode_simd(out, in, n, true);
+}
+
+bool base16_decode(void * _restrict out, const char * _restrict in, size_t n) noexcept {
+	return decode_simd(out, in, n, false);
+}
+
+bool base16_decode_reversed(void * _restrict out, const char * _restrict in, size_t n) noexcept {
+	return decode_simd(out, in, n, true);
+}
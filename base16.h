@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+
+#include "common/compiler.h"
+
+
+// Hex of n bytes into 2n lowercase chars. The reversed forms treat the bytes
+// as a little-endian number, as Bitcoin displays hashes.
+void base16_encode(char * _restrict out, const void * _restrict in, size_t n);
+void base16_encode_reversed(char * _restrict out, const void * _restrict in, size_t n);
+
+// 2n hex chars of either case into n bytes. Returns false if any char is not
+// a hex digit, in which case out is left partly written.
+bool base16_decode(void * _restrict out, const char * _restrict in, size_t n) noexcept;
+bool base16_decode_reversed(void * _restrict out, const char * _restrict in, size_t n) noexcept;
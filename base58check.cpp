@@ -12,6 +12,19 @@ static constexpr char encode[58] = {
 	'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z'
 };
 
+static constexpr int8_t decode['z' - '1' + 1] = {
+	 0,  1,  2,  3,  4,  5,  6,  7,  8, -1, -1, -1, -1, -1, -1, -1,
+	 9, 10, 11, 12, 13, 14, 15, 16, -1, 17, 18, 19, 20, 21, -1, 22,
+	23, 24, 25, 26, 27, 28, 29, 30, 31, 32, -1, -1, -1, -1, -1, -1,
+	33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, -1, 44, 45, 46, 47,
+	48, 49, 50, 51, 52, 53, 54, 55, 56, 57
+};
+
+static int decode_digit(char c) {
+	unsigned i = static_cast<uint8_t>(c) - '1';
+	return i > 'z' - '1' ? -1 : decode[i];
+}
+
 static char * encode_limb(char *out, char *out_begin, mp_limb_t limb) {
 #if GMP_LIMB_BITS == 64
 	size_t n_limb = 10;
@@ -37,10 +50,113 @@ static char * encode_last_limb(char *out, char *out_begin, mp_limb_t limb) {
 	return out;
 }
 
+// Upper bound on the base-58 digits of an n-byte number, as each digit
+// carries more than 100/138 of a byte.
+static constexpr size_t max_digits(size_t n) {
+	return n * 138 / 100 + 1;
+}
+
+// Conversion tables for Base58Check of payloads of exactly N bytes. The
+// number is cut into 24-bit limbs, and each limb's weight is tabulated in
+// base 58^5, so that converting is a set of independent multiply-adds and a
+// single carrying pass instead of a chain of long divisions. Decoding uses the
+// weights of each power of 58^5 in base 2^24 the same way. The loops are
+// unrolled so that the sums stay in registers.
+template <size_t N>
+struct FixedBase58 {
+	static constexpr uint64_t radix = 656356768; // 58**5
+	static constexpr size_t n = N + 4, n_limbs = (n * 8 + 23) / 24, n_groups = max_digits(n) / 5 + 1;
+	// limbs enough to hold 58^(5 n_groups), as log2(58) < 5.86
+	static constexpr size_t n_wide_limbs = n_groups * 5 * 586 / 100 / 24 + 1;
+
+	uint32_t limb_weights[n_limbs][n_groups];
+	uint32_t group_weights[n_groups][n_wide_limbs];
+
+	constexpr FixedBase58() : limb_weights(), group_weights() {
+		uint64_t w[n_groups] = { 1 };
+		for (size_t i = 0; i < n_limbs; ++i) {
+			uint64_t carry = 0;
+			for (size_t k = 0; k < n_groups; ++k) {
+				limb_weights[i][k] = static_cast<uint32_t>(w[k]);
+				carry += w[k] << 24, w[k] = carry % radix, carry /= radix;
+			}
+		}
+		uint64_t v[n_wide_limbs] = { 1 };
+		for (size_t j = 0; j < n_groups; ++j) {
+			uint64_t carry = 0;
+			for (size_t k = 0; k < n_wide_limbs; ++k) {
+				group_weights[j][k] = static_cast<uint32_t>(v[k]);
+				carry += v[k] * radix, v[k] = carry & 0xFFFFFF, carry >>= 24;
+			}
+		}
+	}
+};
+
+template <size_t N>
+static size_t encode_fixed(char * _restrict out, size_t n_out, const void * _restrict in) {
+	typedef FixedBase58<N> T;
+	static constexpr T table;
+	uint8_t bytes[T::n_limbs * 3] = { };
+	uint8_t *payload = bytes + sizeof bytes - T::n;
+	std::memcpy(payload, in, N);
+	SHA256 isha, osha;
+	isha.write_fully(payload, N);
+	osha.write_fully(isha.digest().data(), SHA256::digest_size);
+	std::memcpy(payload + N, osha.digest().data(), 4);
+
+	uint64_t groups[T::n_groups] = { };
+#pragma GCC unroll 32
+	for (size_t i = 0; i < T::n_limbs; ++i) {
+		const uint8_t *p = bytes + sizeof bytes - 3 * (i + 1);
+		uint32_t limb = uint32_t(p[0]) << 16 | uint32_t(p[1]) << 8 | p[2];
+#pragma GCC unroll 32
+		for (size_t k = 0; k < T::n_groups; ++k) {
+			groups[k] += static_cast<uint64_t>(limb) * table.limb_weights[i][k];
+		}
+	}
+	uint64_t carry = 0;
+#pragma GCC unroll 32
+	for (size_t k = 0; k < T::n_groups; ++k) {
+		carry += groups[k], groups[k] = carry % T::radix, carry /= T::radix;
+	}
+	char digits[T::n_groups * 5];
+#pragma GCC unroll 32
+	for (size_t k = 0; k < T::n_groups; ++k) {
+		auto group = static_cast<uint32_t>(groups[k]);
+		for (size_t j = 5; j-- > 0;) {
+			digits[(T::n_groups - 1 - k) * 5 + j] = encode[group % 58], group /= 58;
+		}
+	}
+
+	size_t z = 0, d = 0;
+	while (z < T::n && payload[z] == 0) {
+		++z;
+	}
+	while (d < sizeof digits && digits[d] == '1') {
+		++d;
+	}
+	if (z + sizeof digits - d > n_out) {
+		throw std::logic_error("buffer too small");
+	}
+	std::memset(out, '1', z);
+	std::memcpy(out + z, digits + d, sizeof digits - d);
+	return z + sizeof digits - d;
+}
+
 size_t base58check_encode(char * _restrict out, size_t n_out, const void * _restrict in, size_t n_in) {
 	if (n_out < n_in + 4) {
 		throw std::logic_error("buffer too small");
 	}
+	switch (n_in) {
+		case 21: // address
+			return encode_fixed<21>(out, n_out, in);
+		case 33: // private key
+			return encode_fixed<33>(out, n_out, in);
+		case 34: // private key with flags
+			return encode_fixed<34>(out, n_out, in);
+		case 78: // BIP32 extended key
+			return encode_fixed<78>(out, n_out, in);
+	}
 	SHA256 isha, osha;
 	isha.write_fully(in, n_in);
 	osha.write_fully(isha.digest().data(), SHA256::digest_size);
@@ -77,33 +193,108 @@ std::string base58check_encode(const void *in, size_t n_in) {
 	return ret;
 }
 
-static mp_limb_t decode_limb(const char *in, size_t n_in) {
-	static constexpr int8_t decode['z' - '1' + 1] = {
-		 0,  1,  2,  3,  4,  5,  6,  7,  8, -1, -1, -1, -1, -1, -1, -1,
-		 9, 10, 11, 12, 13, 14, 15, 16, -1, 17, 18, 19, 20, 21, -1, 22,
-		23, 24, 25, 26, 27, 28, 29, 30, 31, 32, -1, -1, -1, -1, -1, -1,
-		33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, -1, 44, 45, 46, 47,
-		48, 49, 50, 51, 52, 53, 54, 55, 56, 57
-	};
-	mp_limb_t limb = 0;
+static bool decode_limb(uint64_t &limb, const char *in, size_t n_in) {
+	limb = 0;
 	while (n_in-- > 0) {
-		unsigned digit = static_cast<uint8_t>(*in++) - '1';
-		if (digit > 'z' - '1' || static_cast<int>(digit = decode[digit]) < 0) {
-			throw std::ios_base::failure("invalid Base58Check");
+		int digit = decode_digit(*in++);
+		if (digit < 0) {
+			return false;
 		}
 		limb = limb * 58 + digit;
 	}
-	return limb;
+	return true;
 }
 
-size_t base58check_decode(void * _restrict out, size_t n_out, const char * _restrict in, size_t n_in) {
+template <size_t N>
+static Base58CheckError decode_fixed(uint8_t * _restrict out, size_t &n_out, const char * _restrict in, size_t n_in) {
+	typedef FixedBase58<N> T;
+	static constexpr T table;
+	size_t z = 0;
+	while (n_in > 0 && *in == '1') {
+		if (z == N) {
+			return Base58CheckError::BUFFER_TOO_SMALL;
+		}
+		out[z++] = 0, ++in, --n_in;
+	}
+	if (n_in > max_digits(T::n)) {
+		return Base58CheckError::BUFFER_TOO_SMALL;
+	}
+
+	// right-aligned digits, checked all together
+	uint8_t digits[T::n_groups * 5] = { };
+	int invalid = 0;
+	for (size_t i = 0; i < n_in; ++i) {
+		int digit = decode_digit(in[i]);
+		invalid |= digit, digits[sizeof digits - n_in + i] = static_cast<uint8_t>(digit);
+	}
+	if (invalid < 0) {
+		return Base58CheckError::INVALID_CHARACTER;
+	}
+	uint64_t limbs[T::n_wide_limbs] = { };
+#pragma GCC unroll 32
+	for (size_t j = 0; j < T::n_groups; ++j) {
+		const uint8_t *q = digits + sizeof digits - 5 * (j + 1);
+		uint32_t group = (((q[0] * 58u + q[1]) * 58 + q[2]) * 58 + q[3]) * 58 + q[4];
+#pragma GCC unroll 32
+		for (size_t k = 0; k < T::n_wide_limbs; ++k) {
+			limbs[k] += static_cast<uint64_t>(group) * table.group_weights[j][k];
+		}
+	}
+	uint64_t carry = 0;
+#pragma GCC unroll 32
+	for (size_t k = 0; k < T::n_wide_limbs; ++k) {
+		carry += limbs[k], limbs[k] = carry & 0xFFFFFF, carry >>= 24;
+	}
+	for (size_t k = T::n_limbs; k < T::n_wide_limbs; ++k) {
+		carry |= limbs[k];
+	}
+	if (carry != 0 || limbs[T::n_limbs - 1] >> (T::n * 8 - (T::n_limbs - 1) * 24) != 0) {
+		return Base58CheckError::BUFFER_TOO_SMALL;
+	}
+
+	uint8_t bytes[T::n_limbs * 3];
+#pragma GCC unroll 32
+	for (size_t i = 0; i < T::n_limbs; ++i) {
+		uint8_t *p = bytes + sizeof bytes - 3 * (i + 1);
+		p[0] = static_cast<uint8_t>(limbs[i] >> 16), p[1] = static_cast<uint8_t>(limbs[i] >> 8), p[2] = static_cast<uint8_t>(limbs[i]);
+	}
+	size_t p = sizeof bytes - T::n, end = sizeof bytes - 4;
+	while (p < end && bytes[p] == 0) {
+		++p;
+	}
+	if (z + (end - p) > N) {
+		return Base58CheckError::BUFFER_TOO_SMALL;
+	}
+	std::memcpy(out + z, bytes + p, end - p);
+	z += end - p;
+	SHA256 isha, osha;
+	isha.write_fully(out, z);
+	osha.write_fully(isha.digest().data(), SHA256::digest_size);
+	if (std::memcmp(bytes + end, osha.digest().data(), 4) != 0) {
+		return Base58CheckError::BAD_CHECKSUM;
+	}
+	n_out = z;
+	return Base58CheckError::OK;
+}
+
+Base58CheckError base58check_try_decode(void * _restrict out, size_t &n_out, const char * _restrict in, size_t n_in) noexcept {
 	if (n_in == 0) {
-		throw std::ios_base::failure("invalid Base58Check");
+		return Base58CheckError::EMPTY;
+	}
+	switch (n_out) {
+		case 21:
+			return decode_fixed<21>(static_cast<uint8_t *>(out), n_out, in, n_in);
+		case 33:
+			return decode_fixed<33>(static_cast<uint8_t *>(out), n_out, in, n_in);
+		case 34:
+			return decode_fixed<34>(static_cast<uint8_t *>(out), n_out, in, n_in);
+		case 78:
+			return decode_fixed<78>(static_cast<uint8_t *>(out), n_out, in, n_in);
 	}
 	uint8_t *p = static_cast<uint8_t *>(out), *end = p + n_out;
 	while (n_in > 0 && *in == '1') {
 		if (p == end) {
-			throw std::logic_error("buffer too small");
+			return Base58CheckError::BUFFER_TOO_SMALL;
 		}
 		*p++ = 0, ++in, --n_in;
 	}
@@ -123,8 +314,12 @@ size_t base58check_decode(void * _restrict out, size_t n_out, const char * _rest
 		};
 		size_t n_limb = std::min(n_in, size_t(5));
 #endif
+		uint64_t limb;
+		if (!decode_limb(limb, in, n_limb)) {
+			return Base58CheckError::INVALID_CHARACTER;
+		}
 		mpn_mul_1(mpn, mpn, sizeof mpn / sizeof *mpn, power[n_limb - 1]);
-		mpn_add_1(mpn, mpn, sizeof mpn / sizeof *mpn, decode_limb(in, n_limb));
+		mpn_add_1(mpn, mpn, sizeof mpn / sizeof *mpn, static_cast<mp_limb_t>(limb));
 		in += n_limb, n_in -= n_limb;
 	}
 	for (auto left = mpn, right = mpn + sizeof mpn / sizeof *mpn; left <= --right; ++left) {
@@ -136,7 +331,7 @@ size_t base58check_decode(void * _restrict out, size_t n_out, const char * _rest
 		++p1;
 	}
 	if (p + (end1 - p1) > end) {
-		throw std::logic_error("buffer too small");
+		return Base58CheckError::BUFFER_TOO_SMALL;
 	}
 	std::memcpy(p, p1, end1 - p1);
 	p += end1 - p1;
@@ -144,7 +339,19 @@ size_t base58check_decode(void * _restrict out, size_t n_out, const char * _rest
 	isha.write_fully(out, p - static_cast<uint8_t *>(out));
 	osha.write_fully(isha.digest().data(), SHA256::digest_size);
 	if (std::memcmp(end1, osha.digest().data(), 4) != 0) {
-		throw std::ios_base::failure("invalid Base58Check");
+		return Base58CheckError::BAD_CHECKSUM;
+	}
+	n_out = p - static_cast<uint8_t *>(out);
+	return Base58CheckError::OK;
+}
+
+size_t base58check_decode(void * _restrict out, size_t n_out, const char * _restrict in, size_t n_in) {
+	switch (base58check_try_decode(out, n_out, in, n_in)) {
+		case Base58CheckError::OK:
+			return n_out;
+		case Base58CheckError::BUFFER_TOO_SMALL:
+			throw std::logic_error("buffer too small");
+		default:
+			throw std::ios_base::failure("invalid Base58Check");
 	}
-	return p - static_cast<uint8_t *>(out);
 }
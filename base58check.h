@@ -1,3 +1,4 @@
+#include <cstdint>
 #include <string>
 
 #include "common/compiler.h"
@@ -7,4 +8,16 @@ size_t base58check_encode(char * _restrict out, size_t n_out, const void * _rest
 
 std::string base58check_encode(const void *in, size_t n_in);
 
+enum class Base58CheckError : uint8_t {
+	OK,
+	EMPTY,
+	INVALID_CHARACTER,
+	BUFFER_TOO_SMALL,
+	BAD_CHECKSUM,
+};
+
 size_t base58check_decode(void * _restrict out, size_t n_out, const char * _restrict in, size_t n_in);
+
+// As above, but reports bad input by return value rather than by throwing, and
+// on success replaces n_out with the decoded size.
+Base58CheckError base58check_try_decode(void * _restrict out, size_t &n_out, const char * _restrict in, size_t n_in) noexcept;
@@ -0,0 +1,309 @@
+#include "bip32.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+#include "base58check.h"
+#include "ecdsa.h"
+#include "hash160.h"
+#include "parallel.h"
+
+
+namespace satoshi {
+
+
+static constexpr uint32_t xprv_version = 0x0488ADE4, xpub_version = 0x0488B21E;
+static constexpr uint32_t testnet_xprv_version = 0x04358394, testnet_xpub_version = 0x043587CF;
+
+
+static void put_be32(uint8_t bytes[4], uint32_t value) {
+	bytes[0] = static_cast<uint8_t>(value >> 24), bytes[1] = static_cast<uint8_t>(value >> 16);
+	bytes[2] = static_cast<uint8_t>(value >> 8), bytes[3] = static_cast<uint8_t>(value);
+}
+
+static uint32_t get_be32(const uint8_t bytes[4]) {
+	return uint32_t(bytes[0]) << 24 | uint32_t(bytes[1]) << 16 | uint32_t(bytes[2]) << 8 | bytes[3];
+}
+
+// keys are never longer than the SHA-512 block, so they are never hashed first
+static void hmac_sha512_init(SHA512 &inner, SHA512 &outer, const void *key, size_t n) {
+	uint8_t pad[SHA512::block_size] = { };
+	std::memcpy(pad, key, n);
+	for (auto &b : pad) {
+		b ^= 0x36;
+	}
+	inner.write_fully(pad, sizeof pad);
+	for (auto &b : pad) {
+		b ^= 0x36 ^ 0x5C;
+	}
+	outer.write_fully(pad, sizeof pad);
+}
+
+static const std::array<uint8_t, 64> & hmac_sha512_final(SHA512 &inner, SHA512 &outer) {
+	outer.write_fully(inner.digest().data(), SHA512::digest_size);
+	return outer.digest();
+}
+
+static void to_pubkey(PublicKey &pubkey, const AffinePoint &Q) {
+	fe_get_mpn(pubkey.Q[0], Q.x), fe_get_mpn(pubkey.Q[1], Q.y);
+	mpn_zero(pubkey.Q[2], MP_NLIMBS(32)), pubkey.Q[2][0] = 1;
+	pubkey.compress = true;
+}
+
+static std::array<uint8_t, 4> fingerprint(const PublicKey &pubkey) {
+	auto hash = pubkey_to_address(serialize_pubkey<33>(pubkey)).hash;
+	return { { hash[0], hash[1], hash[2], hash[3] } };
+}
+
+
+ExtendedPrivateKey bip32_master_key(const void *seed, size_t n) {
+	static constexpr char key[] = "Bitcoin seed";
+	SHA512 inner, outer;
+	hmac_sha512_init(inner, outer, key, sizeof key - 1);
+	inner.write_fully(seed, n);
+	auto &I = hmac_sha512_final(inner, outer);
+	ExtendedPrivateKey ret;
+	bytes_to_mpn(ret.key.d, I.data(), 32);
+	if (mpn_zero_p(ret.key.d, MP_NLIMBS(32)) || mpn_cmp(ret.key.d, secp256k1_n, MP_NLIMBS(32)) >= 0) {
+		throw std::range_error("seed yields no valid master key");
+	}
+	ret.key.flags = PrivateKey::Flags::COMPRESS;
+	std::copy_n(I.data() + 32, 32, ret.chain_code.data());
+	ret.depth = 0;
+	ret.parent_fingerprint.fill(0);
+	ret.child_number = 0;
+	return ret;
+}
+
+ExtendedPublicKey bip32_neuter(const ExtendedPrivateKey &xprv) {
+	ExtendedPublicKey ret;
+	ret.key = privkey_to_pubkey(xprv.key);
+	ret.key.compress = true;
+	ret.chain_code = xprv.chain_code;
+	ret.depth = xprv.depth;
+	ret.parent_fingerprint = xprv.parent_fingerprint;
+	ret.child_number = xprv.child_number;
+	return ret;
+}
+
+ExtendedPrivateKey bip32_derive(const ExtendedPrivateKey &parent, uint32_t index) {
+	if (parent.depth == UINT8_MAX) {
+		throw std::range_error("BIP32 depth limit reached");
+	}
+	auto pubkey = privkey_to_pubkey(parent.key);
+	pubkey.compress = true;
+	SHA512 inner, outer;
+	hmac_sha512_init(inner, outer, parent.chain_code.data(), parent.chain_code.size());
+	uint8_t bytes[37];
+	if (index & bip32_hardened) {
+		bytes[0] = 0;
+		mpn_to_bytes(bytes + 1, parent.key.d, 32);
+	}
+	else {
+		auto serialized = serialize_pubkey<33>(pubkey);
+		std::copy(serialized.bytes.begin(), serialized.bytes.end(), bytes);
+	}
+	put_be32(bytes + 33, index);
+	inner.write_fully(bytes, sizeof bytes);
+	auto &I = hmac_sha512_final(inner, outer);
+
+	// k_i = IL + k (mod n)
+	ExtendedPrivateKey ret;
+	mp_limb_t il[MP_NLIMBS(32)];
+	bytes_to_mpn(il, I.data(), 32);
+	if (mpn_cmp(il, secp256k1_n, MP_NLIMBS(32)) >= 0) {
+		throw std::range_error("BIP32 child index yields no valid key");
+	}
+	if (mpn_add_n(ret.key.d, il, parent.key.d, MP_NLIMBS(32)) || mpn_cmp(ret.key.d, secp256k1_n, MP_NLIMBS(32)) >= 0) {
+		mpn_sub_n(ret.key.d, ret.key.d, secp256k1_n, MP_NLIMBS(32));
+	}
+	if (mpn_zero_p(ret.key.d, MP_NLIMBS(32))) {
+		throw std::range_error("BIP32 child index yields no valid key");
+	}
+	ret.key.flags = PrivateKey::Flags::COMPRESS;
+	std::copy_n(I.data() + 32, 32, ret.chain_code.data());
+	ret.depth = static_cast<uint8_t>(parent.depth + 1);
+	ret.parent_fingerprint = fingerprint(pubkey);
+	ret.child_number = index;
+	return ret;
+}
+
+ExtendedPublicKey bip32_derive(const ExtendedPublicKey &parent, uint32_t index) {
+	return Bip32ChildDeriver(parent).derive(index);
+}
+
+
+static void encode_header(uint8_t bytes[78], uint32_t version, uint8_t depth, const std::array<uint8_t, 4> &parent_fingerprint, uint32_t child_number, const digest256_t &chain_code) {
+	put_be32(bytes, version);
+	bytes[4] = depth;
+	std::copy(parent_fingerprint.begin(), parent_fingerprint.end(), bytes + 5);
+	put_be32(bytes + 9, child_number);
+	std::copy(chain_code.begin(), chain_code.end(), bytes + 13);
+}
+
+template <typename T>
+static bool decode_header(T &key, const uint8_t bytes[78]) {
+	key.depth = bytes[4];
+	std::copy_n(bytes + 5, 4, key.parent_fingerprint.data());
+	key.child_number = get_be32(bytes + 9);
+	std::copy_n(bytes + 13, 32, key.chain_code.data());
+	// a master key has no parent
+	return key.depth != 0 || (get_be32(bytes + 5) == 0 && key.child_number == 0);
+}
+
+ExtendedPrivateKey decode_xprv(const char xprv[], size_t n) {
+	ExtendedPrivateKey ret;
+	uint8_t bytes[78];
+	if (base58check_decode(bytes, sizeof bytes, xprv, n) == sizeof bytes) {
+		uint32_t version = get_be32(bytes);
+		if ((version == xprv_version || version == testnet_xprv_version) && decode_header(ret, bytes) && bytes[45] == 0) {
+			bytes_to_mpn(ret.key.d, bytes + 46, 32);
+			if (!mpn_zero_p(ret.key.d, MP_NLIMBS(32)) && mpn_cmp(ret.key.d, secp256k1_n, MP_NLIMBS(32)) < 0) {
+				ret.key.flags = PrivateKey::Flags::COMPRESS;
+				return ret;
+			}
+		}
+	}
+	throw std::ios_base::failure("expected extended private key");
+}
+
+std::string encode_xprv(const ExtendedPrivateKey &xprv, bool testnet) {
+	uint8_t bytes[78];
+	encode_header(bytes, testnet ? testnet_xprv_version : xprv_version, xprv.depth, xprv.parent_fingerprint, xprv.child_number, xprv.chain_code);
+	bytes[45] = 0;
+	mpn_to_bytes(bytes + 46, xprv.key.d, 32);
+	return base58check_encode(bytes, sizeof bytes);
+}
+
+ExtendedPublicKey decode_xpub(const char xpub[], size_t n) {
+	ExtendedPublicKey ret;
+	uint8_t bytes[78];
+	if (base58check_decode(bytes, sizeof bytes, xpub, n) == sizeof bytes) {
+		uint32_t version = get_be32(bytes);
+		if ((version == xpub_version || version == testnet_xpub_version) && decode_header(ret, bytes) &&
+				(bytes[45] | 1) == 0x03 && parse_pubkey(ret.key, { bytes + 45, 33 })) {
+			return ret;
+		}
+	}
+	throw std::ios_base::failure("expected extended public key");
+}
+
+std::string encode_xpub(const ExtendedPublicKey &xpub, bool testnet) {
+	uint8_t bytes[78];
+	encode_header(bytes, testnet ? testnet_xpub_version : xpub_version, xpub.depth, xpub.parent_fingerprint, xpub.child_number, xpub.chain_code);
+	PublicKey key = xpub.key;
+	key.compress = true;
+	auto serialized = serialize_pubkey<33>(key);
+	std::copy(serialized.bytes.begin(), serialized.bytes.end(), bytes + 45);
+	return base58check_encode(bytes, sizeof bytes);
+}
+
+
+Bip32ChildDeriver::Bip32ChildDeriver(const ExtendedPublicKey &parent) : depth(parent.depth) {
+	if (depth == UINT8_MAX) {
+		throw std::range_error("BIP32 depth limit reached");
+	}
+	PublicKey key = parent.key;
+	decompress_pubkey(key);
+	key.compress = true;
+	fe_set_mpn(this->parent.x, key.Q[0]), fe_set_mpn(this->parent.y, key.Q[1]);
+	fingerprint = satoshi::fingerprint(key);
+	hmac_sha512_init(inner, outer, parent.chain_code.data(), parent.chain_code.size());
+	auto serialized = serialize_pubkey<33>(key);
+	inner.write_fully(serialized.bytes.data(), serialized.bytes.size());
+}
+
+bool Bip32ChildDeriver::tweak(JacobianPoint &child, uint8_t chain_code[], uint32_t index) const {
+	SHA512 inner = this->inner, outer = this->outer;
+	uint8_t bytes[4];
+	put_be32(bytes, index);
+	inner.write_fully(bytes, sizeof bytes);
+	auto &I = hmac_sha512_final(inner, outer);
+	// K_i = IL*G + K
+	mp_limb_t il[MP_NLIMBS(32)];
+	bytes_to_mpn(il, I.data(), 32);
+	if (mpn_cmp(il, secp256k1_n, MP_NLIMBS(32)) >= 0) {
+		return false;
+	}
+	point_mul_gen(child, il);
+	point_add(child, child, parent);
+	if (chain_code) {
+		std::copy_n(I.data() + 32, 32, chain_code);
+	}
+	return !point_is_infinity(child);
+}
+
+ExtendedPublicKey Bip32ChildDeriver::derive(uint32_t index) const {
+	if (index & bip32_hardened) {
+		throw std::invalid_argument("hardened BIP32 child of public key");
+	}
+	ExtendedPublicKey ret;
+	JacobianPoint child;
+	if (!this->tweak(child, ret.chain_code.data(), index)) {
+		throw std::range_error("BIP32 child index yields no valid key");
+	}
+	AffinePoint q;
+	point_to_affine(q, child);
+	to_pubkey(ret.key, q);
+	ret.depth = static_cast<uint8_t>(depth + 1);
+	ret.parent_fingerprint = fingerprint;
+	ret.child_number = index;
+	return ret;
+}
+
+bool Bip32ChildDeriver::derive_range(PublicKey pubkeys[], Address addresses[], uint32_t first, size_t n, bool testnet) const {
+	std::unique_ptr<JacobianPoint[]> jacobian(new JacobianPoint[derivation_batch]);
+	std::unique_ptr<AffinePoint[]> affine(new AffinePoint[derivation_batch]);
+	std::unique_ptr<CompressedPublicKey[]> serialized(addresses ? new CompressedPublicKey[derivation_batch] : nullptr);
+	for (size_t begin = 0; begin < n; begin += derivation_batch) {
+		size_t m = std::min(n - begin, derivation_batch);
+		for (size_t i = 0; i < m; ++i) {
+			if (!this->tweak(jacobian[i], nullptr, static_cast<uint32_t>(first + begin + i))) {
+				return false;
+			}
+		}
+		point_to_affine(affine.get(), jacobian.get(), m);
+		if (pubkeys) {
+			for (size_t i = 0; i < m; ++i) {
+				to_pubkey(pubkeys[begin + i], affine[i]);
+			}
+		}
+		if (addresses) {
+			for (size_t i = 0; i < m; ++i) {
+				serialized[i].bytes[0] = fe_is_odd(affine[i].y) ? 0x03 : 0x02;
+				fe_get_bytes(serialized[i].bytes.data() + 1, affine[i].x);
+			}
+			pubkeys_to_addresses(addresses + begin, serialized.get(), m, testnet);
+		}
+	}
+	return true;
+}
+
+void Bip32ChildDeriver::derive_range(PublicKey pubkeys[], Address addresses[], uint32_t first, size_t n, bool testnet, unsigned n_threads) const {
+	if (n > bip32_hardened || first > bip32_hardened - n) {
+		throw std::invalid_argument("hardened BIP32 child of public key");
+	}
+	std::atomic<bool> valid(true);
+	parallel_ranges(n, derivation_batch, n_threads, [&](size_t begin, size_t end) {
+		if (!this->derive_range(pubkeys ? pubkeys + begin : nullptr, addresses ? addresses + begin : nullptr, static_cast<uint32_t>(first + begin), end - begin, testnet)) {
+			valid.store(false, std::memory_order_relaxed);
+		}
+	});
+	if (!valid.load(std::memory_order_relaxed)) {
+		throw std::range_error("BIP32 child index yields no valid key");
+	}
+}
+
+void Bip32ChildDeriver::derive_pubkeys(PublicKey pubkeys[], uint32_t first, size_t n, unsigned n_threads) const {
+	this->derive_range(pubkeys, nullptr, first, n, false, n_threads);
+}
+
+void Bip32ChildDeriver::derive_addresses(Address addresses[], uint32_t first, size_t n, bool testnet, unsigned n_threads) const {
+	this->derive_range(nullptr, addresses, first, n, testnet, n_threads);
+}
+
+
+} // namespace satoshi
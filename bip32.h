@@ -0,0 +1,77 @@
+#pragma once
+
+#include "secp256k1.h"
+#include "types.h"
+#include "common/sha.h"
+
+
+namespace satoshi {
+
+
+// BIP32 hierarchical deterministic keys
+
+static constexpr uint32_t bip32_hardened = UINT32_C(1) << 31;
+
+struct ExtendedPrivateKey {
+	PrivateKey key;
+	digest256_t chain_code;
+	uint8_t depth;
+	std::array<uint8_t, 4> parent_fingerprint;
+	uint32_t child_number;
+};
+
+struct ExtendedPublicKey {
+	PublicKey key;
+	digest256_t chain_code;
+	uint8_t depth;
+	std::array<uint8_t, 4> parent_fingerprint;
+	uint32_t child_number;
+};
+
+ExtendedPrivateKey bip32_master_key(const void *seed, size_t n);
+ExtendedPublicKey bip32_neuter(const ExtendedPrivateKey &xprv);
+
+// These throw std::range_error for the roughly one in 2^127 indices that yield
+// no valid key, which BIP32 says to skip. Public derivation throws
+// std::invalid_argument for a hardened index.
+ExtendedPrivateKey bip32_derive(const ExtendedPrivateKey &parent, uint32_t index);
+ExtendedPublicKey bip32_derive(const ExtendedPublicKey &parent, uint32_t index);
+
+ExtendedPrivateKey decode_xprv(const char xprv[], size_t n);
+std::string encode_xprv(const ExtendedPrivateKey &xprv, bool testnet = false);
+ExtendedPublicKey decode_xpub(const char xpub[], size_t n);
+std::string encode_xpub(const ExtendedPublicKey &xpub, bool testnet = false);
+
+
+// Derives the non-hardened children of one extended public key, keeping the
+// parent point, its fingerprint, and the HMAC state with the chain code and
+// serialized parent already absorbed, so that each child costs one HMAC
+// finalization, one multiplication of G and one point addition.
+class Bip32ChildDeriver {
+
+private:
+	uint8_t depth;
+	std::array<uint8_t, 4> fingerprint;
+	AffinePoint parent;
+	SHA512 inner, outer;
+
+public:
+	explicit Bip32ChildDeriver(const ExtendedPublicKey &parent);
+
+public:
+	ExtendedPublicKey derive(uint32_t index) const;
+
+	// Derive children first to first + n - 1 at once, in batches sharing one
+	// inversion and spread over threads as privkeys_to_addresses does.
+	void derive_pubkeys(PublicKey pubkeys[], uint32_t first, size_t n, unsigned n_threads = 0) const;
+	void derive_addresses(Address addresses[], uint32_t first, size_t n, bool testnet = false, unsigned n_threads = 0) const;
+
+private:
+	bool tweak(JacobianPoint &child, uint8_t chain_code[], uint32_t index) const;
+	bool derive_range(PublicKey pubkeys[], Address addresses[], uint32_t first, size_t n, bool testnet) const;
+	void derive_range(PublicKey pubkeys[], Address addresses[], uint32_t first, size_t n, bool testnet, unsigned n_threads) const;
+
+};
+
+
+} // namespace satoshi
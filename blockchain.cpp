@@ -1,8 +1,13 @@
 #include "blockchain.h"
 
+#include <algorithm>
 #include <ctime>
+#include <ostream>
+#include <stdexcept>
 
+#include "base16.h"
 #include "common/serial.h"
+#include "common/sha.h"
 
 
 namespace satoshi {
@@ -21,6 +26,10 @@ Source & operator >> (Source &source, TxIn &txin) {
 	return source >> txin.prevout >> txin.script >> txin.seq_num;
 }
 
+Source & operator >> (Source &source, _in_arena<TxIn> txin) {
+	return source >> txin.value.prevout >> in_arena(txin.value.script, txin.arena) >> txin.value.seq_num;
+}
+
 Sink & operator << (Sink &sink, const TxIn &txin) {
 	return sink << txin.prevout << txin.script << txin.seq_num;
 }
@@ -34,6 +43,10 @@ Source & operator >> (Source &source, TxOut &txout) {
 	return source >> txout.amount >> txout.script;
 }
 
+Source & operator >> (Source &source, _in_arena<TxOut> txout) {
+	return source >> txout.value.amount >> in_arena(txout.value.script, txout.arena);
+}
+
 Sink & operator << (Sink &sink, const TxOut &txout) {
 	return sink << txout.amount << txout.script;
 }
@@ -43,19 +56,258 @@ std::ostream & operator << (std::ostream &os, const TxOut &txout) {
 }
 
 
+static constexpr size_t max_witness_item_size = 0x02000000;
+
+static size_t _const compact_size_size(uint64_t n) {
+	return n < 0xFD ? 1 : n <= UINT16_MAX ? 3 : n <= UINT32_MAX ? 5 : 9;
+}
+
+template <typename A>
+static void append_compact_size(std::vector<uint8_t, A> &bytes, uint64_t n) {
+	uint8_t buf[9];
+	size_t size = compact_size_size(n);
+	buf[0] = size == 1 ? static_cast<uint8_t>(n) : size == 3 ? 0xFD : size == 5 ? 0xFE : 0xFF;
+	for (size_t i = 1; i < size; ++i) {
+		buf[i] = static_cast<uint8_t>(n >> 8 * (i - 1));
+	}
+	bytes.insert(bytes.end(), buf, buf + size);
+}
+
+// Only for bytes that append_compact_size() wrote.
+static const uint8_t * decode_compact_size(const uint8_t *p, size_t &n) {
+	size_t size = *p < 0xFD ? 1 : *p == 0xFD ? 3 : *p == 0xFE ? 5 : 9;
+	if (size == 1) {
+		n = *p;
+		return p + 1;
+	}
+	uint64_t v = 0;
+	for (size_t i = size - 1; i > 0; --i) {
+		v = v << 8 | p[i];
+	}
+	n = static_cast<size_t>(v);
+	return p + size;
+}
+
+// Reads the BIP 144 marker and flags that take the place of an empty input
+// list. Returns false for a transaction that has neither inputs nor outputs.
+static bool read_flags(Source &source, size_t &count, uint8_t &flags) {
+	flags = 0;
+	if (count == 0) {
+		source >> flags;
+		if (flags == 0) {
+			return false;
+		}
+		source >> varint(count);
+	}
+	return true;
+}
+
+static void read_witness(Source &source, Tx &tx, uint8_t flags, Arena *arena) {
+	tx.witness = decltype(tx.witness)(arena);
+	tx.witness_offsets = decltype(tx.witness_offsets)(arena);
+	if (flags == 0) {
+		return;
+	}
+	if (flags != 1) {
+		throw std::ios_base::failure("unknown transaction flags");
+	}
+	tx.witness_offsets.reserve(tx.inputs.size());
+	bool empty = true;
+	for (size_t i = 0; i < tx.inputs.size(); ++i) {
+		tx.witness_offsets.push_back(static_cast<uint32_t>(tx.witness.size()));
+		size_t n_items;
+		source >> varint(n_items);
+		append_compact_size(tx.witness, n_items);
+		empty &= n_items == 0;
+		while (n_items-- > 0) {
+			size_t size;
+			source >> varint(size);
+			if (size > max_witness_item_size) {
+				throw std::ios_base::failure("witness item too large");
+			}
+			append_compact_size(tx.witness, size);
+			// an untrusted size is not allocated ahead of the bytes arriving
+			while (size > 0) {
+				size_t n = std::min(size, size_t(1) << 16), offset = tx.witness.size();
+				tx.witness.resize(offset + n);
+				source.read_fully(&tx.witness[offset], n);
+				size -= n;
+			}
+		}
+	}
+	if (empty) {
+		throw std::ios_base::failure("superfluous witness record");
+	}
+}
+
 Source & operator >> (Source &source, Tx &tx) {
-	return source >> tx.version >> tx.inputs >> tx.outputs >> tx.lock_time;
+	size_t count;
+	uint8_t flags;
+	source >> tx.version >> varint(count);
+	bool nonempty = read_flags(source, count, flags);
+	// counts are untrusted, and storage from any arena the transaction was
+	// last read into is let go of
+	tx.inputs = decltype(tx.inputs)();
+	tx.inputs.reserve(std::min(count, Arena::max_reserve));
+	while (count-- > 0) {
+		tx.inputs.emplace_back();
+		source >> tx.inputs.back();
+	}
+	count = 0;
+	if (nonempty) {
+		source >> varint(count);
+	}
+	tx.outputs = decltype(tx.outputs)();
+	tx.outputs.reserve(std::min(count, Arena::max_reserve));
+	while (count-- > 0) {
+		tx.outputs.emplace_back();
+		source >> tx.outputs.back();
+	}
+	read_witness(source, tx, flags, nullptr);
+	return source >> tx.lock_time;
+}
+
+Source & operator >> (Source &source, _in_arena<Tx> in) {
+	auto &tx = in.value;
+	if (holds_arena_elements(tx.inputs) || holds_arena_elements(tx.outputs)) {
+		throw std::invalid_argument("transaction still holds arena-backed inputs or outputs");
+	}
+	size_t count;
+	uint8_t flags;
+	source >> tx.version >> varint(count);
+	bool nonempty = read_flags(source, count, flags);
+	// counts are untrusted, and an arena never gives back what it hands out
+	tx.inputs = decltype(tx.inputs)(&in.arena);
+	tx.inputs.reserve(std::min(count, Arena::max_reserve));
+	while (count-- > 0) {
+		tx.inputs.emplace_back();
+		source >> in_arena(tx.inputs.back(), in.arena);
+	}
+	count = 0;
+	if (nonempty) {
+		source >> varint(count);
+	}
+	tx.outputs = decltype(tx.outputs)(&in.arena);
+	tx.outputs.reserve(std::min(count, Arena::max_reserve));
+	while (count-- > 0) {
+		tx.outputs.emplace_back();
+		source >> in_arena(tx.outputs.back(), in.arena);
+	}
+	read_witness(source, tx, flags, &in.arena);
+	return source >> tx.lock_time;
+}
+
+static Sink & write_tx(Sink &sink, const Tx &tx, bool with_witness) {
+	with_witness = with_witness && !tx.witness.empty();
+	sink << tx.version;
+	if (with_witness) {
+		sink << uint8_t(0) << uint8_t(1);
+	}
+	sink << varint(tx.inputs.size());
+	for (auto &txin : tx.inputs) {
+		sink << txin;
+	}
+	sink << varint(tx.outputs.size());
+	for (auto &txout : tx.outputs) {
+		sink << txout;
+	}
+	if (with_witness) {
+		sink.write_fully(tx.witness.data(), tx.witness.size());
+	}
+	return sink << tx.lock_time;
 }
 
 Sink & operator << (Sink &sink, const Tx &tx) {
-	return sink << tx.version << tx.inputs << tx.outputs << tx.lock_time;
+	return write_tx(sink, tx, true);
 }
 
 std::ostream & operator << (std::ostream &os, const Tx &tx) {
 	using ::operator <<;
-	return os << "{ .version = " << tx.version << ", .inputs = " << tx.inputs << ", .outputs = " << tx.outputs << ", .lock_time = " << tx.lock_time << " }";
+	os << "{ .version = " << tx.version << ", .inputs = " << tx.inputs << ", .outputs = " << tx.outputs << ", .lock_time = " << tx.lock_time;
+	if (!tx.witness.empty()) {
+		os << ", .witness = [";
+		for (size_t i = 0; i < tx.inputs.size(); ++i) {
+			os << (i ? ", [" : " [");
+			size_t j = 0;
+			for (auto item : witness_stack(tx, i)) {
+				os << (j++ ? ", " : " ");
+				char buf[256];
+				for (size_t k = 0; k < item.size(); k += sizeof buf / 2) {
+					size_t n = std::min(item.size() - k, sizeof buf / 2);
+					base16_encode(buf, item.data() + k, n);
+					os.write(buf, n * 2);
+				}
+			}
+			os << " ]";
+		}
+		os << " ]";
+	}
+	return os << " }";
 }
 
+static digest256_t double_sha256(const Tx &tx, bool with_witness) {
+	SHA256 isha;
+	write_tx(isha, tx, with_witness);
+	SHA256 osha;
+	osha << isha.digest();
+	return osha.digest();
+}
+
+digest256_t tx_hash(const Tx &tx) {
+	return double_sha256(tx, false);
+}
+
+digest256_t tx_witness_hash(const Tx &tx) {
+	return double_sha256(tx, true);
+}
+
+size_t tx_stripped_size(const Tx &tx) {
+	size_t size = sizeof tx.version + compact_size_size(tx.inputs.size()) + compact_size_size(tx.outputs.size()) + sizeof tx.lock_time;
+	for (auto &txin : tx.inputs) {
+		size += sizeof txin.prevout + compact_size_size(txin.script.size()) + txin.script.size() + sizeof txin.seq_num;
+	}
+	for (auto &txout : tx.outputs) {
+		size += sizeof txout.amount + compact_size_size(txout.script.size()) + txout.script.size();
+	}
+	return size;
+}
+
+size_t tx_size(const Tx &tx) {
+	return tx_stripped_size(tx) + (tx.witness.empty() ? 0 : 2 + tx.witness.size());
+}
+
+
+WitnessStack::WitnessStack(const uint8_t *stack) {
+	items = decode_compact_size(stack, count);
+}
+
+Span<const uint8_t> WitnessStack::Iterator::operator * () const {
+	size_t size;
+	auto data = decode_compact_size(itr, size);
+	return { data, size };
+}
+
+WitnessStack::Iterator & WitnessStack::Iterator::operator ++ () {
+	size_t size;
+	itr = decode_compact_size(itr, size) + size;
+	--remaining;
+	return *this;
+}
+
+Span<const uint8_t> WitnessStack::operator [] (size_t idx) const {
+	auto itr = this->begin();
+	while (idx-- > 0) {
+		++itr;
+	}
+	return *itr;
+}
+
+WitnessStack witness_stack(const Tx &tx, size_t input) {
+	if (tx.witness.empty()) {
+		return WitnessStack();
+	}
+	return WitnessStack(tx.witness.data() + tx.witness_offsets[input]);
+}
 
 Source & operator >> (Source &source, BlockHeader &hdr) {
 	return source >> hdr.version >> hdr.parent_block_hash >> hdr.merkle_root_hash >> hdr.time >> hdr.bits >> hdr.nonce;
@@ -71,5 +323,13 @@ std::ostream & operator << (std::ostream &os, const BlockHeader &hdr) {
 	return print_digest_le(print_digest_le(os << "{ .version = " << hdr.version << ", .parent_block_hash = ", hdr.parent_block_hash) << ", .merkle_root_hash = ", hdr.merkle_root_hash) << ", .time = " << time << " (" << std::chrono::system_clock::from_time_t(time) << "), .bits = " << compact_to_double(hdr.bits) << ", .nonce = " << hdr.nonce << " }";
 }
 
+digest256_t block_hash(const BlockHeader &hdr) {
+	SHA256 isha;
+	isha << hdr;
+	SHA256 osha;
+	osha << isha.digest();
+	return osha.digest();
+}
+
 
 } // namespace satoshi
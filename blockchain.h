@@ -2,6 +2,8 @@
 
 #include <iosfwd>
 
+#include "arena.h"
+#include "span.h"
 #include "types.h"
 #include "common/endian.h"
 
@@ -25,6 +27,7 @@ struct TxIn {
 };
 
 Source & operator >> (Source &source, TxIn &txin);
+Source & operator >> (Source &source, _in_arena<TxIn> txin);
 Sink & operator << (Sink &sink, const TxIn &txin);
 std::ostream & operator << (std::ostream &os, const TxIn &txin);
 
@@ -35,21 +38,76 @@ struct TxOut {
 };
 
 Source & operator >> (Source & source, TxOut &txout);
+Source & operator >> (Source &source, _in_arena<TxOut> txout);
 Sink & operator << (Sink &sink, const TxOut &txout);
 std::ostream & operator << (std::ostream &os, const TxOut &txout);
 
 
 struct Tx {
 	le<uint32_t> version;
-	std::vector<TxIn> inputs;
-	std::vector<TxOut> outputs;
+	std::vector<TxIn, ArenaAllocator<TxIn>> inputs;
+	std::vector<TxOut, ArenaAllocator<TxOut>> outputs;
 	le<int32_t> lock_time;
+	// BIP 144 witness stacks of all inputs, one after another as serialized on
+	// the wire; kept apart from the inputs, and empty if there are none
+	std::vector<uint8_t, ArenaAllocator<uint8_t>> witness;
+	std::vector<uint32_t, ArenaAllocator<uint32_t>> witness_offsets; // of each input's stack
 };
 
 Source & operator >> (Source &source, Tx &tx);
+Source & operator >> (Source &source, _in_arena<Tx> tx);
 Sink & operator << (Sink &sink, const Tx &tx);
 std::ostream & operator << (std::ostream &os, const Tx &tx);
 
+// over the serialization without witness data
+digest256_t tx_hash(const Tx &tx);
+// over the full serialization; the same as tx_hash() without witness data
+digest256_t tx_witness_hash(const Tx &tx);
+
+size_t tx_stripped_size(const Tx &tx) _pure;
+size_t tx_size(const Tx &tx) _pure;
+static inline size_t tx_weight(const Tx &tx) { return tx_stripped_size(tx) * 3 + tx_size(tx); }
+static inline size_t tx_vsize(const Tx &tx) { return (tx_weight(tx) + 3) / 4; }
+
+
+// View of one input's witness stack.
+class WitnessStack {
+
+public:
+	class Iterator {
+		friend WitnessStack;
+	private:
+		const uint8_t *itr;
+		size_t remaining;
+	private:
+		Iterator(const uint8_t *itr, size_t remaining) : itr(itr), remaining(remaining) { }
+	public:
+		Span<const uint8_t> operator * () const _pure;
+		Iterator & operator ++ ();
+		bool operator == (const Iterator &o) const { return remaining == o.remaining; }
+		bool operator != (const Iterator &o) const { return remaining != o.remaining; }
+	};
+
+private:
+	const uint8_t *items;
+	size_t count;
+
+public:
+	WitnessStack() : items(), count() { }
+	explicit WitnessStack(const uint8_t *stack);
+
+public:
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	Iterator begin() const { return Iterator(items, count); }
+	Iterator end() const { return Iterator(nullptr, 0); }
+	Span<const uint8_t> operator [] (size_t idx) const _pure;
+
+};
+
+// Returns an empty stack for a transaction without witness data.
+WitnessStack witness_stack(const Tx &tx, size_t input) _pure;
+
 
 struct BlockHeader {
 	le<uint32_t> version;
@@ -64,5 +122,7 @@ Source & operator >> (Source &source, BlockHeader &hdr);
 Sink & operator << (Sink &sink, const BlockHeader &hdr);
 std::ostream & operator << (std::ostream &os, const BlockHeader &hdr);
 
+digest256_t block_hash(const BlockHeader &hdr);
+
 
 } // namespace satoshi
@@ -1,5 +1,10 @@
 #include "bloom.h"
 
+#include <algorithm>
+#include <cstring>
+#include <ios>
+
+#include "lanes.h"
 #include "common/endian.h"
 #include "common/murmur3.h"
 #include "common/serial.h"
@@ -8,6 +13,128 @@
 namespace satoshi {
 
 
+// Each of the k hashes of BIP 37 is murmur3_32 of the same bytes under its own
+// seed, and murmur3 mixes each 4-byte block the same way whatever the seed. So
+// each block is mixed once and folded into all k hashes, which are kept side
+// by side in vector lanes.
+static constexpr uint32_t seed_step = 0xFBA4C795;
+static constexpr uint32_t max_lane_hashes = 64; // hashes per pass over the bytes
+
+static _lane_inline uint32_t murmur3_mix(uint32_t k) {
+	k *= 0xCC9E2D51;
+	k = k << 15 | k >> 17;
+	return k * 0x1B873593;
+}
+
+// the first n_vectors * N hashes, kept in registers throughout
+template <size_t N, size_t n_vectors>
+static _lane_inline void murmur3_vectors(uint32_t out[], const uint8_t *data, size_t size, uint32_t seed) {
+	typedef typename Lanes<N>::Vector V;
+	V lanes = { }, h[n_vectors];
+	for (size_t lane = 0; lane < N; ++lane) {
+		lanes[lane] = static_cast<uint32_t>(lane);
+	}
+	for (size_t v = 0; v < n_vectors; ++v) {
+		h[v] = seed + (lanes + static_cast<uint32_t>(v * N)) * seed_step;
+	}
+	size_t n_blocks = size / 4;
+	for (size_t i = 0; i < n_blocks; ++i) {
+		uint32_t k;
+		std::memcpy(&k, data + i * 4, sizeof k);
+		k = murmur3_mix(letoh(k));
+		for (size_t v = 0; v < n_vectors; ++v) {
+			V x = h[v] ^ k;
+			h[v] = (x << 13 | x >> 19) * 5 + 0xE6546B64;
+		}
+	}
+	auto tail = data + n_blocks * 4;
+	uint32_t k = 0;
+	switch (size & 3) {
+		case 3:
+			k ^= tail[2] << 16;
+			// fall through
+		case 2:
+			k ^= tail[1] << 8;
+			// fall through
+		case 1:
+			k ^= tail[0];
+			k = murmur3_mix(k);
+	}
+	for (size_t v = 0; v < n_vectors; ++v) {
+		V x = h[v] ^ k ^ static_cast<uint32_t>(size);
+		x ^= x >> 16, x *= 0x85EBCA6B;
+		x ^= x >> 13, x *= 0xC2B2AE35;
+		x ^= x >> 16;
+		std::memcpy(out + v * N, &x, sizeof x);
+	}
+}
+
+// Hashes up to four vectors' worth in one pass and returns how many.
+template <size_t N>
+static _lane_inline uint32_t murmur3_lanes(uint32_t out[], const uint8_t *data, size_t size, uint32_t seed, uint32_t n_hashes) {
+	switch (n_hashes <= N ? 1 : n_hashes <= N * 2 ? 2 : n_hashes <= N * 3 ? 3 : 4) {
+		case 1:
+			murmur3_vectors<N, 1>(out, data, size, seed);
+			return std::min<uint32_t>(n_hashes, N);
+		case 2:
+			murmur3_vectors<N, 2>(out, data, size, seed);
+			return std::min<uint32_t>(n_hashes, N * 2);
+		case 3:
+			murmur3_vectors<N, 3>(out, data, size, seed);
+			return std::min<uint32_t>(n_hashes, N * 3);
+	}
+	murmur3_vectors<N, 4>(out, data, size, seed);
+	return std::min<uint32_t>(n_hashes, N * 4);
+}
+
+#ifdef LANES_X86
+
+__attribute__((__target__("avx512f")))
+static uint32_t murmur3_avx512(uint32_t out[], const uint8_t *data, size_t size, uint32_t seed, uint32_t n_hashes) {
+	return murmur3_lanes<16>(out, data, size, seed, n_hashes);
+}
+
+__attribute__((__target__("avx2")))
+static uint32_t murmur3_avx2(uint32_t out[], const uint8_t *data, size_t size, uint32_t seed, uint32_t n_hashes) {
+	return murmur3_lanes<8>(out, data, size, seed, n_hashes);
+}
+
+#endif
+
+static uint32_t murmur3_generic(uint32_t out[], const uint8_t *data, size_t size, uint32_t seed, uint32_t n_hashes) {
+	return murmur3_lanes<4>(out, data, size, seed, n_hashes);
+}
+
+// murmur3_32 under n_hashes seeds, at most max_lane_hashes, starting at seed.
+// out must have room for n_hashes rounded up to a multiple of 16.
+static void murmur3_seeds(uint32_t out[], const void *data, size_t size, uint32_t seed, uint32_t n_hashes) {
+#ifdef LANES_X86
+	static const auto lanes = select_lanes(&murmur3_generic, nullptr, &murmur3_avx2, &murmur3_avx512);
+#else
+	static const auto lanes = &murmur3_generic;
+#endif
+	for (uint32_t done = 0; done < n_hashes;) {
+		done += lanes(out + done, static_cast<const uint8_t *>(data), size, seed + done * seed_step, n_hashes - done);
+	}
+}
+
+
+// BIP 37 takes each hash modulo the number of bits, so the bits set are fixed
+// by the protocol and cannot come from a cheaper range reduction. Lemire's
+// fastmod gives exactly x % d for 32-bit x with a multiplication by a constant
+// worked out once per filter size.
+class BitIndexer {
+	uint64_t n_bits, m;
+public:
+	explicit BitIndexer(size_t n_bytes) : n_bits(uint64_t(n_bytes) * 8), m(n_bits - 1 < UINT32_MAX ? UINT64_MAX / n_bits + 1 : 0) { }
+	size_t operator () (uint32_t hash) const {
+		if (n_bits - 1 >= UINT32_MAX) {
+			return hash; // never wraps
+		}
+		return static_cast<size_t>(static_cast<unsigned __int128>(m * hash) * n_bits >> 64);
+	}
+};
+
 static inline void set_bit(uint8_t *bits, size_t bit_idx) {
 	bits[bit_idx / 8] = static_cast<uint8_t>(bits[bit_idx / 8] | 1 << bit_idx % 8);
 }
@@ -17,25 +144,72 @@ static inline bool test_bit(const uint8_t *bits, size_t bit_idx) {
 }
 
 
+constexpr size_t BloomFilter::max_size;
+constexpr uint32_t BloomFilter::max_hash_count;
+
+
+// An empty filter, which would have the hashes taken modulo zero, matches
+// everything, as in Bitcoin Core.
+
 void BloomFilter::insert(const void *data, size_t data_size) {
-	size_t n_bits = bits.size() * 8;
-	uint32_t seed = _tweak;
-	for (uint32_t hash_idx = 0; hash_idx < _hash_count; ++hash_idx) {
-		set_bit(bits.data(), murmur3_32(data, data_size, seed) % n_bits);
-		seed += 0xfba4c795;
-	}
+	this->insert_many(data, data_size, 1);
 }
 
 bool BloomFilter::maybe_contains(const void *data, size_t data_size) const {
-	size_t n_bits = bits.size() * 8;
-	uint32_t seed = _tweak;
-	for (uint32_t hash_idx = 0; hash_idx < _hash_count; ++hash_idx) {
-		if (!test_bit(bits.data(), murmur3_32(data, data_size, seed) % n_bits)) {
-			return false;
+	bool ret;
+	this->maybe_contains_many(&ret, data, data_size, 1);
+	return ret;
+}
+
+void BloomFilter::insert_many(const void *data, size_t data_size, size_t n) {
+	if (bits.empty()) {
+		return;
+	}
+	BitIndexer indexer(bits.size());
+	uint32_t hashes[max_lane_hashes];
+	auto bytes = static_cast<const uint8_t *>(data);
+	for (size_t i = 0; i < n; ++i) {
+		// counted down, as a count off the wire may be near UINT32_MAX
+		uint32_t seed = _tweak;
+		for (uint32_t left = _hash_count, n_hashes; left > 0; left -= n_hashes, seed += n_hashes * seed_step) {
+			n_hashes = std::min(left, max_lane_hashes);
+			murmur3_seeds(hashes, bytes + i * data_size, data_size, seed, n_hashes);
+			for (uint32_t j = 0; j < n_hashes; ++j) {
+				set_bit(bits.data(), indexer(hashes[j]));
+			}
 		}
-		seed += 0xfba4c795;
 	}
-	return true;
+}
+
+void BloomFilter::maybe_contains_many(bool out[], const void *data, size_t data_size, size_t n) const {
+	if (bits.empty()) {
+		std::fill(out, out + n, true);
+		return;
+	}
+	// Most elements not in a filter miss on the first bit, so that is found
+	// on its own, and its byte is prefetched while the element before is
+	// tested. Only elements that get past it have the rest hashed in lanes.
+	BitIndexer indexer(bits.size());
+	uint32_t hashes[max_lane_hashes];
+	auto bytes = static_cast<const uint8_t *>(data);
+	size_t next_bit = n > 0 ? indexer(murmur3_32(bytes, data_size, _tweak)) : 0;
+	for (size_t i = 0; i < n; ++i) {
+		size_t first_bit = next_bit;
+		if (i + 1 < n) {
+			next_bit = indexer(murmur3_32(bytes + (i + 1) * data_size, data_size, _tweak));
+			__builtin_prefetch(&bits[next_bit / 8]);
+		}
+		bool match = _hash_count == 0 || test_bit(bits.data(), first_bit);
+		uint32_t seed = _tweak + seed_step;
+		for (uint32_t left = _hash_count > 0 ? _hash_count - 1 : 0, n_hashes; left > 0 && match; left -= n_hashes, seed += n_hashes * seed_step) {
+			n_hashes = std::min(left, max_lane_hashes);
+			murmur3_seeds(hashes, bytes + i * data_size, data_size, seed, n_hashes);
+			for (uint32_t j = 0; j < n_hashes && match; ++j) {
+				match = test_bit(bits.data(), indexer(hashes[j]));
+			}
+		}
+		out[i] = match;
+	}
 }
 
 Sink & operator << (Sink &sink, const BloomFilter &filter) {
@@ -43,9 +217,19 @@ Sink & operator << (Sink &sink, const BloomFilter &filter) {
 }
 
 Source & operator >> (Source &source, BloomFilter &filter) {
-	source >> filter.bits >> filter._hash_count >> filter._tweak;
+	size_t size;
+	source >> varint(size);
+	if (size > BloomFilter::max_size) {
+		throw std::ios_base::failure("bloom filter too large");
+	}
+	filter.bits.resize(size);
+	source.read_fully(filter.bits.data(), size);
+	source >> filter._hash_count >> filter._tweak;
 	filter._hash_count = as_le(filter._hash_count);
 	filter._tweak = as_le(filter._tweak);
+	if (filter._hash_count > BloomFilter::max_hash_count) {
+		throw std::ios_base::failure("bloom filter has too many hash functions");
+	}
 	return source;
 }
 
@@ -1,3 +1,5 @@
+#pragma once
+
 #include <chrono>
 #include <cmath>
 #include <cstddef>
@@ -15,6 +17,11 @@ class BloomFilter {
 	friend Sink & operator << (Sink &, const BloomFilter &);
 	friend Source & operator >> (Source &, BloomFilter &);
 
+public:
+	// BIP 37 limits, beyond which a filter from a peer is refused
+	static constexpr size_t max_size = 36000;
+	static constexpr uint32_t max_hash_count = 50;
+
 private:
 	std::vector<uint8_t> bits;
 	uint32_t _hash_count, _tweak;
@@ -23,8 +30,8 @@ public:
 	BloomFilter() : _hash_count(), _tweak() { }
 	BloomFilter(size_t size, uint32_t hash_count, uint32_t tweak) : bits(size), _hash_count(hash_count), _tweak(tweak) { }
 	BloomFilter(size_t capacity, double pfp, uint32_t tweak) :
-			bits(std::min(static_cast<size_t>(std::ceil(static_cast<double>(capacity) * std::log(pfp) / -(std::log(2) * std::log(2)) / 8)), size_t(36000))),
-			_hash_count(std::min(static_cast<uint32_t>(std::lround(std::log(2) * 8 * static_cast<double>(bits.size()) / static_cast<double>(capacity))), 50u)),
+			bits(std::min(static_cast<size_t>(std::ceil(static_cast<double>(capacity) * std::log(pfp) / -(std::log(2) * std::log(2)) / 8)), max_size)),
+			_hash_count(std::min(static_cast<uint32_t>(std::lround(std::log(2) * 8 * static_cast<double>(bits.size()) / static_cast<double>(capacity))), max_hash_count)),
 			_tweak(tweak) { }
 	BloomFilter(size_t capacity, double pfp) : BloomFilter(capacity, pfp, static_cast<uint32_t>(std::chrono::steady_clock::now().time_since_epoch().count())) { }
 
@@ -37,6 +44,9 @@ public:
 
 	void insert(const void *data, size_t data_size);
 	bool maybe_contains(const void *data, size_t data_size) const _pure;
+	// n elements of data_size bytes each, one after another
+	void insert_many(const void *data, size_t data_size, size_t n);
+	void maybe_contains_many(bool out[], const void *data, size_t data_size, size_t n) const;
 
 };
 
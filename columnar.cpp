@@ -0,0 +1,183 @@
+#include "columnar.h"
+
+#include <algorithm>
+#include <cstring>
+#include <ios>
+#include <type_traits>
+
+#include "lanes.h"
+#include "common/endian.h"
+
+
+namespace satoshi {
+
+
+static_assert(sizeof(BlockHeader) == 80 && std::is_trivially_copyable<BlockHeader>::value, "BlockHeader is not its wire form");
+
+// smallest serializations, for bounding untrusted counts by the bytes left
+static constexpr size_t min_tx_size = 10, min_txin_size = 41, min_txout_size = 9;
+
+// walks a block's bytes, checking each read against the end
+class WireCursor {
+	const uint8_t *p, *end;
+public:
+	explicit WireCursor(Span<const uint8_t> bytes) : p(bytes.begin()), end(bytes.end()) { }
+	size_t remaining() const { return end - p; }
+	const uint8_t * take(size_t n) {
+		if (n > this->remaining()) {
+			throw std::ios_base::failure("premature end of block");
+		}
+		auto q = p;
+		p += n;
+		return q;
+	}
+	uint8_t byte() { return *this->take(1); }
+	template <typename T> T le_int() { le<T> v; std::memcpy(&v, this->take(sizeof v), sizeof v); return letoh(v); }
+	size_t varint() {
+		uint8_t b = this->byte();
+		if (b < 0xFD) {
+			return b;
+		}
+		size_t n = b == 0xFD ? 2 : b == 0xFE ? 4 : 8;
+		auto q = this->take(n);
+		uint64_t v = 0;
+		for (size_t i = n; i > 0; --i) {
+			v = v << 8 | q[i - 1];
+		}
+		return static_cast<size_t>(v);
+	}
+};
+
+// the same checks as the BIP 144 parsing in blockchain.cpp
+static void skip_witness(WireCursor &cursor, size_t n_inputs) {
+	bool empty = true;
+	for (size_t i = 0; i < n_inputs; ++i) {
+		size_t n_items = cursor.varint();
+		empty &= n_items == 0;
+		while (n_items-- > 0) {
+			cursor.take(cursor.varint());
+		}
+	}
+	if (empty) {
+		throw std::ios_base::failure("superfluous witness record");
+	}
+}
+
+static void read_tx(ColumnarBlock &block, WireCursor &cursor) {
+	cursor.take(4);
+	size_t count = cursor.varint();
+	uint8_t flags = 0;
+	if (count == 0) {
+		if ((flags = cursor.byte()) != 0) {
+			if (flags != 1) {
+				throw std::ios_base::failure("unknown transaction flags");
+			}
+			count = cursor.varint();
+		}
+	}
+	size_t n_inputs = count;
+	while (count-- > 0) {
+		block.prevout_hashes.emplace_back();
+		std::memcpy(block.prevout_hashes.back().data(), cursor.take(32), 32);
+		block.prevout_indices.push_back(cursor.le_int<uint32_t>());
+		cursor.take(cursor.varint());
+		cursor.take(4);
+	}
+	count = n_inputs > 0 || flags != 0 ? cursor.varint() : 0;
+	while (count-- > 0) {
+		block.amounts.push_back(cursor.le_int<uint64_t>());
+		size_t size = cursor.varint();
+		Span<const uint8_t> script(cursor.take(size), size);
+		block.script_types.push_back(classify_script(script).type);
+		block.scripts.insert(block.scripts.end(), script.begin(), script.end());
+		block.script_offsets.push_back(static_cast<uint32_t>(block.scripts.size()));
+	}
+	if (flags != 0) {
+		skip_witness(cursor, n_inputs);
+	}
+	cursor.take(4);
+	block.input_offsets.push_back(static_cast<uint32_t>(block.prevout_indices.size()));
+	block.output_offsets.push_back(static_cast<uint32_t>(block.amounts.size()));
+}
+
+void read_columnar_block(ColumnarBlock &block, Span<const uint8_t> bytes) {
+	if (bytes.size() > UINT32_MAX) {
+		throw std::ios_base::failure("block too large");
+	}
+	WireCursor cursor(bytes);
+	std::memcpy(static_cast<BlockHeader *>(&block), cursor.take(sizeof(BlockHeader)), sizeof(BlockHeader));
+	size_t count = cursor.varint();
+	// counts are untrusted, but none can be more than the bytes left allow
+	size_t remaining = cursor.remaining();
+	block.input_offsets.assign(1, 0), block.output_offsets.assign(1, 0);
+	block.input_offsets.reserve(std::min(count, remaining / min_tx_size) + 1);
+	block.output_offsets.reserve(std::min(count, remaining / min_tx_size) + 1);
+	block.prevout_hashes.clear(), block.prevout_indices.clear();
+	block.prevout_hashes.reserve(remaining / min_txin_size);
+	block.prevout_indices.reserve(remaining / min_txin_size);
+	block.amounts.clear(), block.script_types.clear();
+	block.amounts.reserve(remaining / min_txout_size);
+	block.script_types.reserve(remaining / min_txout_size);
+	block.script_offsets.assign(1, 0);
+	block.script_offsets.reserve(remaining / min_txout_size + 1);
+	block.scripts.clear();
+	block.scripts.reserve(remaining);
+	while (count-- > 0) {
+		read_tx(block, cursor);
+	}
+	if (cursor.remaining() != 0) {
+		throw std::ios_base::failure("trailing bytes after block");
+	}
+}
+
+
+// The aggregates work on whole vectors with the generic vector types of
+// lanes.h, which compile to whatever the target has.
+uint64_t sum_output_amounts(const ColumnarBlock &block) {
+	auto amounts = block.amounts.data();
+	size_t n = block.amounts.size(), i = 0;
+	Words4 sums0 = { }, sums1 = { };
+	for (; i + 8 <= n; i += 8) {
+		Words4 x0, x1;
+		std::memcpy(&x0, amounts + i, sizeof x0);
+		std::memcpy(&x1, amounts + i + 4, sizeof x1);
+		sums0 += x0, sums1 += x1;
+	}
+	sums0 += sums1;
+	uint64_t sum = sums0[0] + sums0[1] + sums0[2] + sums0[3];
+	for (; i < n; ++i) {
+		sum += amounts[i];
+	}
+	return sum;
+}
+
+void count_script_types(size_t counts[n_script_types], const ColumnarBlock &block) {
+	static_assert(sizeof(ScriptType) == 1, "script types are not bytes");
+	auto types = reinterpret_cast<const uint8_t *>(block.script_types.data());
+	size_t n = block.script_types.size(), i = 0;
+	// each type is counted in byte lanes, which are added out before they can
+	// wrap around
+	while (n - i >= sizeof(Bytes16)) {
+		Bytes16 lanes[n_script_types] = { };
+		size_t end = i + std::min((n - i) / sizeof(Bytes16), size_t(UINT8_MAX)) * sizeof(Bytes16);
+		for (; i < end; i += sizeof(Bytes16)) {
+			Bytes16 x;
+			std::memcpy(&x, types + i, sizeof x);
+#pragma GCC unroll 16
+			for (size_t t = 0; t < n_script_types; ++t) {
+				lanes[t] -= reinterpret_cast<Bytes16>(x == static_cast<uint8_t>(t));
+			}
+		}
+		for (size_t t = 0; t < n_script_types; ++t) {
+			for (size_t lane = 0; lane < sizeof(Bytes16); ++lane) {
+				counts[t] += lanes[t][lane];
+			}
+		}
+	}
+	for (; i < n; ++i) {
+		++counts[types[i]];
+	}
+}
+
+
+} // namespace satoshi
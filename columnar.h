@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+
+#include "blockchain.h"
+#include "span.h"
+#include "standard.h"
+
+
+namespace satoshi {
+
+
+static constexpr size_t n_script_types = static_cast<size_t>(ScriptType::WITNESS_UNKNOWN) + 1;
+
+
+// A block stored a column per field, for scans that touch only a few fields
+// of many outputs. The inputs of transaction i are input_offsets[i] up to
+// input_offsets[i + 1] in the input columns, and likewise its outputs. The
+// script of output j is script_offsets[j] up to script_offsets[j + 1] in
+// scripts. Input scripts and witness data are not kept.
+struct ColumnarBlock : BlockHeader {
+	std::vector<uint32_t> input_offsets, output_offsets; // one more than there are transactions
+	std::vector<digest256_t> prevout_hashes;
+	std::vector<uint32_t> prevout_indices;
+	std::vector<uint64_t> amounts;
+	std::vector<ScriptType> script_types;
+	std::vector<uint32_t> script_offsets; // one more than there are outputs
+	std::vector<uint8_t> scripts;
+
+	size_t tx_count() const { return output_offsets.empty() ? 0 : output_offsets.size() - 1; }
+	Span<const uint8_t> output_script(size_t idx) const { return { scripts.data() + script_offsets[idx], script_offsets[idx + 1] - script_offsets[idx] }; }
+};
+
+// Fills block from the payload of a block message, classifying each output
+// script on the way and reusing whatever the columns already hold. Throws
+// std::ios_base::failure unless the bytes are exactly one block.
+void read_columnar_block(ColumnarBlock &block, Span<const uint8_t> bytes);
+
+// Wraps around if the amounts are not valid, so check the block first.
+uint64_t sum_output_amounts(const ColumnarBlock &block) _pure;
+
+// Adds the number of outputs of each type to counts, indexed by ScriptType.
+void count_script_types(size_t counts[n_script_types], const ColumnarBlock &block);
+
+
+} // namespace satoshi
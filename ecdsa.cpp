@@ -0,0 +1,205 @@
+#include "ecdsa.h"
+
+#include <cstring>
+
+#include "interpreter.h"
+#include "secp256k1.h"
+#include "common/ecp.h"
+#include "common/fp.h"
+
+
+namespace satoshi {
+
+
+static constexpr size_t n_limbs = MP_NLIMBS(32);
+
+static constexpr mp_limb_t secp256k1_n_minus_2[n_limbs] = {
+	MP_LIMB_C(0xD036413F, 0xBFD25E8C), MP_LIMB_C(0xAF48A03B, 0xBAAEDCE6),
+	MP_LIMB_C(0xFFFFFFFE, 0xFFFFFFFF), MP_LIMB_C(0xFFFFFFFF, 0xFFFFFFFF)
+};
+
+
+static bool read_der_length(size_t &length, const uint8_t *&pc, const uint8_t *end) {
+	if (pc == end) {
+		return false;
+	}
+	length = *pc++;
+	if (length & 0x80) {
+		size_t n = length - 0x80;
+		if (n > static_cast<size_t>(end - pc)) {
+			return false;
+		}
+		for (; n > 0 && *pc == 0; --n) {
+			++pc;
+		}
+		if (n >= 4) {
+			return false;
+		}
+		for (length = 0; n > 0; --n) {
+			length = length << 8 | *pc++;
+		}
+	}
+	return length <= static_cast<size_t>(end - pc);
+}
+
+static bool read_der_integer(Span<const uint8_t> &integer, const uint8_t *&pc, const uint8_t *end) {
+	size_t length;
+	if (pc == end || *pc++ != 0x02 || !read_der_length(length, pc, end)) {
+		return false;
+	}
+	integer = { pc, length };
+	pc += length;
+	return true;
+}
+
+static bool set_component(mp_limb_t r[], Span<const uint8_t> integer) {
+	while (!integer.empty() && integer[0] == 0) {
+		integer = integer.subspan(1);
+	}
+	if (integer.size() > 32) {
+		return false;
+	}
+	uint8_t bytes[32] = { };
+	std::memcpy(bytes + 32 - integer.size(), integer.data(), integer.size());
+	bytes_to_mpn(r, bytes, sizeof bytes);
+	return mpn_cmp(r, secp256k1_n, n_limbs) < 0;
+}
+
+bool parse_signature(Signature &sig, Span<const uint8_t> der, bool strict) {
+	if (strict) {
+		// the script interpreter's check expects a trailing sighash type byte
+		uint8_t bytes[73];
+		if (der.size() >= sizeof bytes) {
+			return false;
+		}
+		std::memcpy(bytes, der.data(), der.size());
+		bytes[der.size()] = 0;
+		if (!is_valid_signature_encoding({ bytes, der.size() + 1 })) {
+			return false;
+		}
+	}
+	// In the manner of OpenSSL before 1.0.0p, the sequence length is skipped
+	// over, lengths may be padded with zeros, and trailing bytes are ignored.
+	auto pc = der.begin(), end = der.end();
+	size_t length;
+	Span<const uint8_t> r, s;
+	if (pc == end || *pc++ != 0x30 || pc == end) {
+		return false;
+	}
+	if ((length = *pc++) & 0x80) {
+		if ((length -= 0x80) > static_cast<size_t>(end - pc)) {
+			return false;
+		}
+		pc += length;
+	}
+	if (!read_der_integer(r, pc, end) || !read_der_integer(s, pc, end)) {
+		return false;
+	}
+	if (!set_component(sig.r, r) || !set_component(sig.s, s)) {
+		// parsed, but can never verify
+		mpn_zero(sig.r, n_limbs), mpn_zero(sig.s, n_limbs);
+	}
+	return true;
+}
+
+bool parse_pubkey(PublicKey &pubkey, Span<const uint8_t> bytes) {
+	if (bytes.empty()) {
+		return false;
+	}
+	AffinePoint Q;
+	switch (bytes[0]) {
+		case 0x02:
+		case 0x03: {
+			if (bytes.size() != 33 || !fe_set_bytes(Q.x, bytes.data() + 1)) {
+				return false;
+			}
+			FieldElement y2;
+			fe_sqr(y2, Q.x);
+			fe_mul(y2, y2, Q.x);
+			fe_set_int(Q.y, 7);
+			fe_add(y2, y2, Q.y);
+			if (!fe_sqrt(Q.y, y2)) {
+				return false;
+			}
+			if (fe_is_odd(Q.y) != (bytes[0] & 1)) {
+				fe_neg(Q.y, Q.y);
+			}
+			pubkey.compress = true;
+			break;
+		}
+		case 0x04:
+		case 0x06:
+		case 0x07: // hybrid encoding carries both y and its parity
+			if (bytes.size() != 65 || !fe_set_bytes(Q.x, bytes.data() + 1) || !fe_set_bytes(Q.y, bytes.data() + 33) || !point_on_curve(Q)) {
+				return false;
+			}
+			if (bytes[0] != 0x04 && fe_is_odd(Q.y) != (bytes[0] & 1)) {
+				return false;
+			}
+			pubkey.compress = false;
+			break;
+		default:
+			return false;
+	}
+	fe_get_mpn(pubkey.Q[0], Q.x);
+	fe_get_mpn(pubkey.Q[1], Q.y);
+	mpn_zero(pubkey.Q[2], n_limbs), pubkey.Q[2][0] = 1;
+	return true;
+}
+
+bool ecdsa_verify(const PublicKey &pubkey, const digest256_t &hash, const Signature &sig) {
+	if (mpn_zero_p(sig.r, n_limbs) || mpn_zero_p(sig.s, n_limbs)) {
+		return false;
+	}
+	// u1 = z/s and u2 = r/s modulo the group order
+	mp_limb_t z[n_limbs], w[n_limbs], u1[n_limbs], u2[n_limbs];
+	bytes_to_mpn(z, hash.data(), 32);
+	if (mpn_cmp(z, secp256k1_n, n_limbs) >= 0) {
+		mpn_sub_n(z, z, secp256k1_n, n_limbs);
+	}
+	fp_pow(w, sig.s, secp256k1_n_minus_2, secp256k1_n);
+	fp_mul(u1, z, w, secp256k1_n);
+	fp_mul(u2, sig.r, w, secp256k1_n);
+
+	PublicKey key = pubkey;
+	decompress_pubkey(key);
+	JacobianPoint Q, R;
+	fe_set_mpn(Q.X, key.Q[0]), fe_set_mpn(Q.Y, key.Q[1]), fe_set_mpn(Q.Z, key.Q[2]);
+	point_mul_gen_add(R, u1, u2, Q);
+	if (point_is_infinity(R)) {
+		return false;
+	}
+
+	// compare x(R) = X/Z^2 with r, and with r + n too since x(R) may exceed n
+	FieldElement zz, x;
+	fe_sqr(zz, R.Z);
+	fe_set_mpn(x, sig.r);
+	fe_mul(x, x, zz);
+	if (fe_equal(x, R.X)) {
+		return true;
+	}
+	mp_limb_t r[n_limbs];
+	if (mpn_add_n(r, sig.r, secp256k1_n, n_limbs) || mpn_cmp(r, secp256k1_p, n_limbs) >= 0) {
+		return false;
+	}
+	fe_set_mpn(x, r);
+	fe_mul(x, x, zz);
+	return fe_equal(x, R.X);
+}
+
+bool verify_signature(Span<const uint8_t> sig, Span<const uint8_t> pubkey, const digest256_t &hash) {
+	PublicKey key;
+	Signature signature;
+	return parse_pubkey(key, pubkey) && parse_signature(signature, sig) && ecdsa_verify(key, hash, signature);
+}
+
+size_t verify_signatures(bool results[], const SignatureCheck checks[], size_t n) {
+	size_t n_valid = 0;
+	for (size_t i = 0; i < n; ++i) {
+		n_valid += results[i] = verify_signature(checks[i].sig, checks[i].pubkey, *checks[i].hash);
+	}
+	return n_valid;
+}
+
+
+} // namespace satoshi
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "span.h"
+#include "types.h"
+
+
+namespace satoshi {
+
+
+struct Signature {
+	mp_limb_t r[MP_NLIMBS(32)], s[MP_NLIMBS(32)];
+};
+
+// Parses a DER-encoded signature without a sighash type byte. Strict parsing
+// accepts only BIP 66 encodings; lax parsing accepts everything that the
+// reference client's OpenSSL-era parser did. Either way, a component that is
+// not less than the group order yields a signature that never verifies.
+bool parse_signature(Signature &sig, Span<const uint8_t> der, bool strict = false);
+
+// Parses a compressed, uncompressed or hybrid public key into affine
+// coordinates, rejecting any that is not a point on the curve.
+bool parse_pubkey(PublicKey &pubkey, Span<const uint8_t> bytes);
+
+bool ecdsa_verify(const PublicKey &pubkey, const digest256_t &hash, const Signature &sig);
+
+// Checks a lax DER signature over a message hash by a serialized public key,
+// as consensus does; usable as a SignatureVerifier.
+bool verify_signature(Span<const uint8_t> sig, Span<const uint8_t> pubkey, const digest256_t &hash);
+
+struct SignatureCheck {
+	Span<const uint8_t> sig, pubkey;
+	const digest256_t *hash;
+};
+
+// Verifies every check and returns how many passed.
+size_t verify_signatures(bool results[], const SignatureCheck checks[], size_t n);
+
+
+} // namespace satoshi
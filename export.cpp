@@ -0,0 +1,191 @@
+#include "export.h"
+
+#include <cstring>
+
+#include "base16.h"
+#include "base58check.h"
+#include "standard.h"
+
+
+namespace satoshi {
+
+
+static constexpr char digit_pairs[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+// worst case for each piece, so that a whole transaction's room can be
+// reserved up front and then written without any bounds checks
+static constexpr size_t max_uint_chars = 20, max_name_chars = 32, max_address_chars = 40;
+
+static char * format_uint(char *p, uint64_t value) {
+	char buf[max_uint_chars], *q = buf + sizeof buf;
+	for (; value >= 100; value /= 100) {
+		q -= 2, std::memcpy(q, digit_pairs + value % 100 * 2, 2);
+	}
+	if (value >= 10) {
+		q -= 2, std::memcpy(q, digit_pairs + value * 2, 2);
+	}
+	else {
+		*--q = static_cast<char>('0' + value);
+	}
+	size_t n = buf + sizeof buf - q;
+	std::memcpy(p, q, n);
+	return p + n;
+}
+
+static char * format_int(char *p, int64_t value) {
+	if (value < 0) {
+		*p++ = '-';
+		return format_uint(p, -static_cast<uint64_t>(value));
+	}
+	return format_uint(p, value);
+}
+
+template <size_t N>
+static char * format_literal(char *p, const char (&s)[N]) {
+	std::memcpy(p, s, N - 1);
+	return p + N - 1;
+}
+
+static char * format_string(char *p, const char *s) {
+	size_t n = std::strlen(s);
+	std::memcpy(p, s, n);
+	return p + n;
+}
+
+static char * format_hash(char *p, const digest256_t &hash) {
+	base16_encode_reversed(p, &hash, sizeof hash);
+	return p + sizeof hash * 2;
+}
+
+static char * format_hex(char *p, const Script &script) {
+	base16_encode(p, script.data(), script.size());
+	return p + script.size() * 2;
+}
+
+static char * format_type(char *p, ScriptType type) {
+	if (auto name = script_type_name(type)) {
+		return format_string(p, name);
+	}
+	return format_uint(p, static_cast<unsigned>(type));
+}
+
+// the address of a PUBKEYHASH or SCRIPTHASH output, or nothing
+static char * format_address(char *p, const ScriptMatch &match, bool testnet) {
+	Address address;
+	if (!match_to_address(address, match, testnet)) {
+		return p;
+	}
+	return p + base58check_encode(p, max_address_chars, &address, sizeof address);
+}
+
+
+void BlockExporter::write_header() {
+	if (format == ExportFormat::CSV) {
+		static constexpr char header[] = "block,height,time,txid,vout,value,type,address,script\n";
+		char *p = this->reserve(sizeof header);
+		p = format_literal(p, header);
+		_size = p - buffer.get();
+	}
+}
+
+void BlockExporter::write(const BlockMessage &block, uint32_t height) {
+	auto hash = block_hash(block);
+	for (auto &tx : block.txns) {
+		this->write(tx, hash, height, block.time);
+	}
+}
+
+void BlockExporter::write(const Tx &tx, const digest256_t &block_id, uint32_t height, uint32_t time) {
+	auto txid = tx_hash(tx);
+	if (format == ExportFormat::CSV) {
+		// the block and transaction fields are the same on every row, so
+		// format them once and copy them onto each
+		char prefix[sizeof(digest256_t) * 2 + sizeof txid * 2 + max_uint_chars * 2 + 4], *q = prefix;
+		q = format_hash(q, block_id), *q++ = ',';
+		q = format_uint(q, height), *q++ = ',';
+		q = format_uint(q, time), *q++ = ',';
+		q = format_hash(q, txid), *q++ = ',';
+		size_t n_prefix = q - prefix, n = 0;
+		for (auto &txout : tx.outputs) {
+			n += n_prefix + max_uint_chars * 2 + max_name_chars + max_address_chars + txout.script.size() * 2 + 6;
+		}
+		char *p = this->reserve(n);
+		for (size_t vout = 0; vout < tx.outputs.size(); ++vout) {
+			auto &txout = tx.outputs[vout];
+			auto match = classify_script(txout.script);
+			std::memcpy(p, prefix, n_prefix), p += n_prefix;
+			p = format_uint(p, vout), *p++ = ',';
+			p = format_uint(p, txout.amount), *p++ = ',';
+			p = format_type(p, match.type), *p++ = ',';
+			p = format_address(p, match, testnet), *p++ = ',';
+			p = format_hex(p, txout.script), *p++ = '\n';
+		}
+		_size = p - buffer.get();
+		return;
+	}
+	size_t n = 512;
+	n += tx.inputs.size() * (sizeof txid * 2 + max_uint_chars * 2 + 48);
+	for (auto &txout : tx.outputs) {
+		n += max_uint_chars + max_name_chars + max_address_chars + txout.script.size() * 2 + 64;
+	}
+	char *p = this->reserve(n);
+	p = format_hash(format_literal(p, "{\"block\":\""), block_id);
+	p = format_uint(format_literal(p, "\",\"height\":"), height);
+	p = format_uint(format_literal(p, ",\"time\":"), time);
+	p = format_hash(format_literal(p, ",\"txid\":\""), txid);
+	p = format_uint(format_literal(p, "\",\"version\":"), tx.version);
+	p = format_int(format_literal(p, ",\"locktime\":"), tx.lock_time);
+	p = format_uint(format_literal(p, ",\"size\":"), tx_size(tx));
+	p = format_uint(format_literal(p, ",\"vsize\":"), tx_vsize(tx));
+	p = format_literal(p, ",\"inputs\":[");
+	for (size_t i = 0; i < tx.inputs.size(); ++i) {
+		auto &txin = tx.inputs[i];
+		if (i > 0) {
+			*p++ = ',';
+		}
+		p = format_hash(format_literal(p, "{\"txid\":\""), txin.prevout.tx_hash);
+		p = format_uint(format_literal(p, "\",\"vout\":"), txin.prevout.txout_idx);
+		p = format_uint(format_literal(p, ",\"sequence\":"), txin.seq_num);
+		*p++ = '}';
+	}
+	p = format_literal(p, "],\"outputs\":[");
+	for (size_t i = 0; i < tx.outputs.size(); ++i) {
+		auto &txout = tx.outputs[i];
+		auto match = classify_script(txout.script);
+		if (i > 0) {
+			*p++ = ',';
+		}
+		p = format_uint(format_literal(p, "{\"value\":"), txout.amount);
+		p = format_literal(format_type(format_literal(p, ",\"type\":\""), match.type), "\"");
+		char *address = format_literal(p, ",\"address\":\""), *end = format_address(address, match, testnet);
+		if (end != address) {
+			p = format_literal(end, "\"");
+		}
+		p = format_hex(format_literal(p, ",\"script\":\""), txout.script);
+		p = format_literal(p, "\"}");
+	}
+	p = format_literal(p, "]}\n");
+	_size = p - buffer.get();
+}
+
+char * BlockExporter::reserve(size_t n) {
+	if (_size + n > capacity) {
+		size_t new_capacity = capacity ? capacity : 1 << 16;
+		while (new_capacity < _size + n) {
+			new_capacity *= 2;
+		}
+		std::unique_ptr<char[]> new_buffer(new char[new_capacity]);
+		if (_size > 0) {
+			std::memcpy(new_buffer.get(), buffer.get(), _size);
+		}
+		buffer = std::move(new_buffer);
+		capacity = new_capacity;
+	}
+	return buffer.get() + _size;
+}
+
+
+} // namespace satoshi
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <memory>
+
+#include "blockchain.h"
+
+
+namespace satoshi {
+
+
+struct BlockMessage;
+
+enum class ExportFormat : uint8_t {
+	JSON_LINES, // one object per transaction
+	CSV, // one row per output
+};
+
+
+// Formats blocks for bulk export into one buffer that grows as needed and is
+// reused after clear(). Exporters share nothing, so a chain can be exported
+// a block per thread and the buffers written out in order.
+class BlockExporter {
+
+private:
+	ExportFormat format;
+	bool testnet;
+	std::unique_ptr<char[]> buffer;
+	size_t _size, capacity;
+
+public:
+	explicit BlockExporter(ExportFormat format, bool testnet = false) : format(format), testnet(testnet), _size(), capacity() { }
+
+public:
+	const char * data() const { return buffer.get(); }
+	size_t size() const { return _size; }
+	void clear() { _size = 0; }
+
+	// the CSV column names; nothing for JSON lines
+	void write_header();
+	void write(const BlockMessage &block, uint32_t height);
+	void write(const Tx &tx, const digest256_t &block_id, uint32_t height, uint32_t time);
+
+private:
+	char * reserve(size_t n);
+
+};
+
+
+} // namespace satoshi
@@ -0,0 +1,276 @@
+#include "hash160.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "lanes.h"
+#include "common/ripemd.h"
+#include "common/serial.h"
+#include "common/sha.h"
+
+
+namespace satoshi {
+
+
+static_assert(sizeof(CompressedPublicKey) == 33 && sizeof(UncompressedPublicKey) == 65, "serialized public keys must pack tightly");
+
+static constexpr uint32_t sha256_k[64] = {
+	0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+	0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+	0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+	0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+	0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+	0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+	0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+	0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+};
+
+static constexpr uint32_t sha256_init[8] = {
+	0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+// message word order, rotation amounts and constants of RIPEMD-160's left and right lines
+static constexpr uint8_t ripemd160_r[2][80] = { {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+	7, 4, 13, 1, 10, 6, 15, 3, 12, 0, 9, 5, 2, 14, 11, 8,
+	3, 10, 14, 4, 9, 15, 8, 1, 2, 7, 0, 6, 13, 11, 5, 12,
+	1, 9, 11, 10, 0, 8, 12, 4, 13, 3, 7, 15, 14, 5, 6, 2,
+	4, 0, 5, 9, 7, 12, 2, 10, 14, 1, 3, 8, 11, 6, 15, 13
+}, {
+	5, 14, 7, 0, 9, 2, 11, 4, 13, 6, 15, 8, 1, 10, 3, 12,
+	6, 11, 3, 7, 0, 13, 5, 10, 14, 15, 8, 12, 4, 9, 1, 2,
+	15, 5, 1, 3, 7, 14, 6, 9, 11, 8, 12, 2, 10, 0, 4, 13,
+	8, 6, 4, 1, 3, 11, 15, 0, 5, 12, 2, 13, 9, 7, 10, 14,
+	12, 15, 10, 4, 1, 5, 8, 7, 6, 2, 13, 14, 0, 3, 9, 11
+} };
+
+static constexpr uint8_t ripemd160_s[2][80] = { {
+	11, 14, 15, 12, 5, 8, 7, 9, 11, 13, 14, 15, 6, 7, 9, 8,
+	7, 6, 8, 13, 11, 9, 7, 15, 7, 12, 15, 9, 11, 7, 13, 12,
+	11, 13, 6, 7, 14, 9, 13, 15, 14, 8, 13, 6, 5, 12, 7, 5,
+	11, 12, 14, 15, 14, 15, 9, 8, 9, 14, 5, 6, 8, 6, 5, 12,
+	9, 15, 5, 11, 6, 8, 13, 12, 5, 12, 13, 14, 11, 8, 5, 6
+}, {
+	8, 9, 9, 11, 13, 15, 15, 5, 7, 7, 8, 11, 14, 14, 12, 6,
+	9, 13, 15, 7, 12, 8, 9, 11, 7, 7, 12, 7, 6, 15, 13, 11,
+	9, 7, 15, 11, 8, 6, 6, 14, 12, 13, 5, 14, 13, 13, 7, 5,
+	15, 5, 8, 11, 14, 14, 6, 14, 6, 9, 12, 9, 12, 5, 15, 8,
+	8, 5, 12, 9, 12, 5, 14, 6, 8, 13, 6, 5, 15, 13, 11, 11
+} };
+
+static constexpr uint32_t ripemd160_k[2][5] = {
+	{ 0x00000000, 0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xA953FD4E },
+	{ 0x50A28BE6, 0x5C4DD124, 0x6D703EF3, 0x7A6D76E9, 0x00000000 }
+};
+
+static constexpr uint32_t ripemd160_init[5] = {
+	0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0
+};
+
+
+// vector code, as lanes.h describes; _rotl is a macro, as it yields a vector
+#define _rotl(x, n) ((x) << (n) | (x) >> (32 - (n)))
+
+template <typename V>
+static _lane_inline void bswap(V &x) {
+	x = x << 24 | (x & 0xFF00) << 8 | (x >> 8 & 0xFF00) | x >> 24;
+}
+
+template <typename V>
+static _lane_inline void sha256_compress(V state[8], V w[16]) {
+	V a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+	for (unsigned t = 0; t < 64; ++t) {
+		if (t >= 16) {
+			V w2 = w[(t - 2) % 16], w15 = w[(t - 15) % 16];
+			w[t % 16] += (_rotl(w2, 15) ^ _rotl(w2, 13) ^ w2 >> 10) + w[(t - 7) % 16] + (_rotl(w15, 25) ^ _rotl(w15, 14) ^ w15 >> 3);
+		}
+		V t1 = h + (_rotl(e, 26) ^ _rotl(e, 21) ^ _rotl(e, 7)) + (e & f ^ ~e & g) + sha256_k[t] + w[t % 16];
+		V t2 = (_rotl(a, 30) ^ _rotl(a, 19) ^ _rotl(a, 10)) + (a & b ^ a & c ^ b & c);
+		h = g, g = f, f = e, e = d + t1, d = c, c = b, b = a, a = t1 + t2;
+	}
+	state[0] += a, state[1] += b, state[2] += c, state[3] += d, state[4] += e, state[5] += f, state[6] += g, state[7] += h;
+}
+
+template <typename V>
+static _lane_inline void ripemd160_f(V &f, unsigned round, const V &x, const V &y, const V &z) {
+	switch (round) {
+		case 0: f = x ^ y ^ z; break;
+		case 1: f = x & y | ~x & z; break;
+		case 2: f = (x | ~y) ^ z; break;
+		case 3: f = x & z | y & ~z; break;
+		default: f = x ^ (y | ~z); break;
+	}
+}
+
+template <typename V>
+static _lane_inline void ripemd160_compress(V state[5], const V x[16]) {
+	V a[2], b[2], c[2], d[2], e[2];
+	for (unsigned line = 0; line < 2; ++line) {
+		a[line] = state[0], b[line] = state[1], c[line] = state[2], d[line] = state[3], e[line] = state[4];
+		for (unsigned j = 0; j < 80; ++j) {
+			// the right line runs through the boolean functions backwards
+			unsigned round = j / 16;
+			V f;
+			ripemd160_f(f, line ? 4 - round : round, b[line], c[line], d[line]);
+			V t = _rotl(a[line] + f + x[ripemd160_r[line][j]] + ripemd160_k[line][round], ripemd160_s[line][j]) + e[line];
+			a[line] = e[line], e[line] = d[line], d[line] = _rotl(c[line], 10), c[line] = b[line], b[line] = t;
+		}
+	}
+	V t = state[1] + c[0] + d[1];
+	state[1] = state[2] + d[0] + e[1];
+	state[2] = state[3] + e[0] + a[1];
+	state[3] = state[4] + a[0] + b[1];
+	state[4] = state[0] + b[0] + c[1];
+	state[0] = t;
+}
+
+// hashes keys of the given size, N at a time, and returns how many it hashed
+template <size_t N>
+static _lane_inline size_t hash160_lanes(digest160_t out[], const uint8_t keys[], size_t size, size_t n) {
+	typedef typename Lanes<N>::Vector V;
+	size_t n_blocks = size < 56 ? 1 : 2;
+	size_t done = 0;
+	for (; n - done >= N; done += N) {
+		// every key padded to whole SHA-256 blocks, with its length in bits at the end
+		uint8_t padded[N][128] = { };
+		for (size_t lane = 0; lane < N; ++lane) {
+			std::memcpy(padded[lane], keys + (done + lane) * size, size);
+			padded[lane][size] = 0x80;
+			padded[lane][n_blocks * 64 - 2] = static_cast<uint8_t>(size * 8 >> 8);
+			padded[lane][n_blocks * 64 - 1] = static_cast<uint8_t>(size * 8);
+		}
+		// a loop here trips GCC's -Wmaybe-uninitialized at -O3
+		V state[8] = {
+			V { } + sha256_init[0], V { } + sha256_init[1], V { } + sha256_init[2], V { } + sha256_init[3],
+			V { } + sha256_init[4], V { } + sha256_init[5], V { } + sha256_init[6], V { } + sha256_init[7]
+		};
+		for (size_t block = 0; block < n_blocks; ++block) {
+			V w[16];
+			for (size_t i = 0; i < 16; ++i) {
+				uint32_t words[N];
+				for (size_t lane = 0; lane < N; ++lane) {
+					auto p = padded[lane] + block * 64 + i * 4;
+					words[lane] = static_cast<uint32_t>(p[0]) << 24 | static_cast<uint32_t>(p[1]) << 16 | static_cast<uint32_t>(p[2]) << 8 | p[3];
+				}
+				std::memcpy(&w[i], words, sizeof words);
+			}
+			sha256_compress(state, w);
+		}
+
+		// the big-endian SHA-256 digest read as RIPEMD-160's little-endian words
+		V x[16];
+		for (size_t i = 0; i < 8; ++i) {
+			x[i] = state[i];
+			bswap(x[i]);
+		}
+		x[8] = V { } + 0x80;
+		for (size_t i = 9; i < 16; ++i) {
+			x[i] = V { };
+		}
+		x[14] = V { } + 256;
+		V h[5];
+		for (size_t i = 0; i < 5; ++i) {
+			h[i] = V { } + ripemd160_init[i];
+		}
+		ripemd160_compress(h, x);
+
+		for (size_t i = 0; i < 5; ++i) {
+			uint32_t words[N];
+			std::memcpy(words, &h[i], sizeof words);
+			for (size_t lane = 0; lane < N; ++lane) {
+				auto p = out[done + lane].data() + i * 4;
+				p[0] = static_cast<uint8_t>(words[lane]), p[1] = static_cast<uint8_t>(words[lane] >> 8);
+				p[2] = static_cast<uint8_t>(words[lane] >> 16), p[3] = static_cast<uint8_t>(words[lane] >> 24);
+			}
+		}
+	}
+	return done;
+}
+
+#ifdef LANES_X86
+
+__attribute__((__target__("avx512f")))
+static size_t hash160_avx512(digest160_t out[], const uint8_t keys[], size_t size, size_t n) {
+	return hash160_lanes<16>(out, keys, size, n);
+}
+
+__attribute__((__target__("avx2")))
+static size_t hash160_avx2(digest160_t out[], const uint8_t keys[], size_t size, size_t n) {
+	return hash160_lanes<8>(out, keys, size, n);
+}
+
+#endif
+
+static size_t hash160_generic(digest160_t out[], const uint8_t keys[], size_t size, size_t n) {
+	return hash160_lanes<4>(out, keys, size, n);
+}
+
+static size_t hash160_simd(digest160_t out[], const uint8_t keys[], size_t size, size_t n) {
+#ifdef LANES_X86
+	static const auto lanes = select_lanes(&hash160_generic, nullptr, &hash160_avx2, &hash160_avx512);
+#else
+	static const auto lanes = &hash160_generic;
+#endif
+	return lanes(out, keys, size, n);
+}
+
+static void hash160(digest160_t out[], const uint8_t keys[], size_t size, size_t n) {
+	for (size_t i = hash160_simd(out, keys, size, n); i < n; ++i) {
+		SHA256 sha;
+		sha.write_fully(keys + i * size, size);
+		RIPEMD160 rmd;
+		rmd << sha.digest();
+		out[i] = rmd.digest();
+	}
+}
+
+void hash160(digest160_t out[], const CompressedPublicKey pubkeys[], size_t n) {
+	hash160(out, reinterpret_cast<const uint8_t *>(pubkeys), sizeof *pubkeys, n);
+}
+
+void hash160(digest160_t out[], const UncompressedPublicKey pubkeys[], size_t n) {
+	hash160(out, reinterpret_cast<const uint8_t *>(pubkeys), sizeof *pubkeys, n);
+}
+
+
+template <size_t N>
+void pubkeys_to_addresses(Address out[], const SerializedPublicKey<N> pubkeys[], size_t n, bool testnet) {
+	std::vector<digest160_t> hashes(n);
+	hash160(hashes.data(), pubkeys, n);
+	for (size_t i = 0; i < n; ++i) {
+		out[i] = { testnet ? Address::Type::TESTNET_PUBKEY_HASH : Address::Type::PUBKEY_HASH, hashes[i] };
+	}
+}
+
+template void pubkeys_to_addresses(Address [], const CompressedPublicKey [], size_t, bool);
+template void pubkeys_to_addresses(Address [], const UncompressedPublicKey [], size_t, bool);
+
+void pubkeys_to_addresses(Address out[], const PublicKey pubkeys[], size_t n, bool testnet) {
+	// keys of each size go through the lanes together
+	std::vector<CompressedPublicKey> compressed;
+	std::vector<UncompressedPublicKey> uncompressed;
+	std::vector<size_t> compressed_idx, uncompressed_idx;
+	for (size_t i = 0; i < n; ++i) {
+		if (pubkeys[i].compress) {
+			compressed.push_back(serialize_pubkey<33>(pubkeys[i]));
+			compressed_idx.push_back(i);
+		}
+		else {
+			uncompressed.push_back(serialize_pubkey<65>(pubkeys[i]));
+			uncompressed_idx.push_back(i);
+		}
+	}
+	std::vector<Address> addresses(std::max(compressed.size(), uncompressed.size()));
+	pubkeys_to_addresses(addresses.data(), compressed.data(), compressed.size(), testnet);
+	for (size_t i = 0; i < compressed.size(); ++i) {
+		out[compressed_idx[i]] = addresses[i];
+	}
+	pubkeys_to_addresses(addresses.data(), uncompressed.data(), uncompressed.size(), testnet);
+	for (size_t i = 0; i < uncompressed.size(); ++i) {
+		out[uncompressed_idx[i]] = addresses[i];
+	}
+}
+
+
+} // namespace satoshi
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "types.h"
+
+
+namespace satoshi {
+
+
+// HASH160, i.e. RIPEMD-160 of SHA-256, of many public keys at once. Keys are
+// hashed side by side in 16, 8 or 4 lanes with AVX-512, AVX2 or SSE2, as the
+// processor allows, and whatever is left over one at a time.
+void hash160(digest160_t out[], const CompressedPublicKey pubkeys[], size_t n);
+void hash160(digest160_t out[], const UncompressedPublicKey pubkeys[], size_t n);
+
+template <size_t N> void pubkeys_to_addresses(Address out[], const SerializedPublicKey<N> pubkeys[], size_t n, bool testnet = false);
+void pubkeys_to_addresses(Address out[], const PublicKey pubkeys[], size_t n, bool testnet = false);
+
+
+} // namespace satoshi
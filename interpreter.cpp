@@ -0,0 +1,953 @@
+#include "interpreter.h"
+
+#include <ostream>
+
+#include "common/endian.h"
+#include "common/ripemd.h"
+#include "common/sha.h"
+
+
+namespace satoshi {
+
+
+constexpr size_t Interpreter::max_script_size;
+constexpr size_t Interpreter::max_element_size;
+constexpr size_t Interpreter::max_ops;
+constexpr size_t Interpreter::max_stack_size;
+constexpr size_t Interpreter::max_pubkeys;
+
+typedef Interpreter::Element Element;
+
+static constexpr uint8_t small_ints[] = { 0x81, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
+static const Element element_true(&small_ints[1], 1), element_false;
+
+
+std::ostream & operator << (std::ostream &os, ScriptError error) {
+	switch (error) {
+#define _(e) case ScriptError::e: return os << #e;
+		_(OK)
+		_(UNKNOWN)
+		_(EVAL_FALSE)
+		_(OP_RETURN)
+		_(SCRIPT_SIZE)
+		_(PUSH_SIZE)
+		_(OP_COUNT)
+		_(STACK_SIZE)
+		_(SIG_COUNT)
+		_(PUBKEY_COUNT)
+		_(INVALID_NUMBER)
+		_(VERIFY)
+		_(EQUALVERIFY)
+		_(CHECKMULTISIGVERIFY)
+		_(CHECKSIGVERIFY)
+		_(NUMEQUALVERIFY)
+		_(BAD_OPCODE)
+		_(DISABLED_OPCODE)
+		_(INVALID_STACK_OPERATION)
+		_(INVALID_ALTSTACK_OPERATION)
+		_(UNBALANCED_CONDITIONAL)
+		_(NEGATIVE_LOCKTIME)
+		_(UNSATISFIED_LOCKTIME)
+		_(MINIMALDATA)
+		_(SIG_DER)
+		_(SIG_NULLDUMMY)
+		_(SIG_PUSHONLY)
+#undef _
+	}
+	return os << static_cast<unsigned>(error);
+}
+
+
+bool SignatureChecker::check_sig(Span<const uint8_t>, Span<const uint8_t>, Span<const uint8_t>) const {
+	return false;
+}
+
+bool SignatureChecker::check_lock_time(int64_t) const {
+	return false;
+}
+
+bool SignatureChecker::check_sequence(int64_t) const {
+	return false;
+}
+
+
+static bool is_minimal_push(Script::Opcode opcode, Element data) {
+	if (data.size() == 0) {
+		return opcode == Script::OP_0;
+	}
+	if (data.size() == 1 && data[0] >= 1 && data[0] <= 16) {
+		return false;
+	}
+	if (data.size() == 1 && data[0] == 0x81) {
+		return false;
+	}
+	if (data.size() < Script::OP_PUSHDATA1) {
+		return opcode == data.size();
+	}
+	if (data.size() <= UINT8_MAX) {
+		return opcode == Script::OP_PUSHDATA1;
+	}
+	if (data.size() <= UINT16_MAX) {
+		return opcode == Script::OP_PUSHDATA2;
+	}
+	return true;
+}
+
+static bool decode_num(Element element, size_t max_size, bool require_minimal, int64_t &value) {
+	size_t size = element.size();
+	if (size > max_size) {
+		return false;
+	}
+	if (require_minimal && size > 0 && (element[size - 1] & 0x7F) == 0 && (size <= 1 || (element[size - 2] & 0x80) == 0)) {
+		return false;
+	}
+	if (size == 0) {
+		value = 0;
+		return true;
+	}
+	uint64_t magnitude = 0;
+	for (size_t i = 0; i < size; ++i) {
+		magnitude |= static_cast<uint64_t>(element[i]) << 8 * i;
+	}
+	auto sign = UINT64_C(0x80) << 8 * (size - 1);
+	value = magnitude & sign ? -static_cast<int64_t>(magnitude & ~sign) : static_cast<int64_t>(magnitude);
+	return true;
+}
+
+bool cast_to_bool(Span<const uint8_t> element) {
+	for (size_t i = 0; i < element.size(); ++i) {
+		if (element[i] != 0) {
+			// negative zero is false
+			return i != element.size() - 1 || element[i] != 0x80;
+		}
+	}
+	return false;
+}
+
+bool is_valid_signature_encoding(Span<const uint8_t> sig) {
+	// 0x30 [total-length] 0x02 [R-length] [R] 0x02 [S-length] [S] [sighash]
+	size_t size = sig.size();
+	if (size < 9 || size > 73 || sig[0] != 0x30 || sig[1] != size - 3) {
+		return false;
+	}
+	size_t len_r = sig[3];
+	if (5 + len_r >= size) {
+		return false;
+	}
+	size_t len_s = sig[5 + len_r];
+	if (len_r + len_s + 7 != size) {
+		return false;
+	}
+	if (sig[2] != 0x02 || len_r == 0 || sig[4] & 0x80 || len_r > 1 && sig[4] == 0x00 && !(sig[5] & 0x80)) {
+		return false;
+	}
+	if (sig[len_r + 4] != 0x02 || len_s == 0 || sig[len_r + 6] & 0x80 || len_s > 1 && sig[len_r + 6] == 0x00 && !(sig[len_r + 7] & 0x80)) {
+		return false;
+	}
+	return true;
+}
+
+bool is_push_only(Span<const uint8_t> script) {
+	auto pc = script.begin(), end = script.end();
+	while (pc < end) {
+		Script::Opcode opcode;
+		Element data;
+		if (!read_op(pc, end, opcode, data) || opcode > Script::OP_16) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool is_pay_to_script_hash(Span<const uint8_t> script) {
+	return script.size() == 23 && script[0] == Script::OP_HASH160 && script[1] == 20 && script[22] == Script::OP_EQUAL;
+}
+
+
+// Tracks nested IF/ELSE/ENDIF without storing one flag per level: all that
+// matters for execution is whether any level is false.
+class ConditionStack {
+	static constexpr uint32_t no_false = UINT32_MAX;
+	uint32_t size, first_false;
+public:
+	ConditionStack() : size(), first_false(no_false) { }
+	bool empty() const { return size == 0; }
+	bool all_true() const { return first_false == no_false; }
+	void push(bool value) {
+		if (first_false == no_false && !value) {
+			first_false = size;
+		}
+		++size;
+	}
+	void pop() {
+		if (--size == first_false) {
+			first_false = no_false;
+		}
+	}
+	void toggle_top() {
+		if (first_false == no_false) {
+			first_false = size - 1;
+		}
+		else if (first_false == size - 1) {
+			first_false = no_false;
+		}
+	}
+};
+
+
+struct Interpreter::Machine {
+	Interpreter &interp;
+	ScriptFlags flags;
+	const SignatureChecker &checker;
+	const DecodedScript &script;
+	const uint8_t *code_begin, *end;
+	ConditionStack conditions;
+	size_t op_count;
+
+	Machine(Interpreter &interp, const DecodedScript &script, ScriptFlags flags, const SignatureChecker &checker) :
+			interp(interp), flags(flags), checker(checker), script(script), code_begin(script.script().begin()), end(script.script().end()), op_count() { }
+
+	bool has(ScriptFlags flag) const { return (flags & flag) != ScriptFlags::NONE; }
+
+	Stack & altstack() { return interp.altstack; }
+	size_t depth() const { return interp.stack.size; }
+	Element & top(size_t i = 1) { return interp.stack.items[interp.stack.size - i]; }
+	void pop(size_t n = 1) { interp.stack.size -= n; }
+	bool push(Element element) {
+		if (interp.stack.size == max_stack_size) {
+			return false;
+		}
+		interp.stack.items[interp.stack.size++] = element;
+		return true;
+	}
+
+	bool get_num(Element element, int64_t &value, size_t max_size = 4) {
+		return decode_num(element, max_size, this->has(ScriptFlags::VERIFY_MINIMALDATA), value);
+	}
+
+	Element make_num(int64_t value) {
+		uint8_t bytes[9];
+		size_t size = 0;
+		if (value != 0) {
+			bool negative = value < 0;
+			uint64_t magnitude = negative ? -static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+			while (magnitude) {
+				bytes[size++] = static_cast<uint8_t>(magnitude);
+				magnitude >>= 8;
+			}
+			if (bytes[size - 1] & 0x80) {
+				bytes[size++] = negative ? 0x80 : 0x00;
+			}
+			else if (negative) {
+				bytes[size - 1] |= 0x80;
+			}
+		}
+		return this->copy(bytes, size);
+	}
+
+	Element copy(const void *data, size_t size) {
+		auto p = static_cast<uint8_t *>(interp.arena.allocate(size, 1));
+		std::memcpy(p, data, size);
+		return { p, size };
+	}
+
+	// Removes every push of `sig` from the script code, as legacy signature
+	// hashing requires. The common case where the script code does not
+	// contain the signature does not copy anything.
+	Element find_and_delete(Element script_code, Element sig);
+
+	ScriptError check_signature_encoding(Element sig) const {
+		if (sig.size() > 0 && this->has(ScriptFlags::VERIFY_DERSIG) && !is_valid_signature_encoding(sig)) {
+			return ScriptError::SIG_DER;
+		}
+		return ScriptError::OK;
+	}
+
+	ScriptError run();
+};
+
+Element Interpreter::Machine::find_and_delete(Element script_code, Element sig) {
+	uint8_t prefix[5];
+	size_t prefix_size;
+	if (sig.size() < Script::OP_PUSHDATA1) {
+		prefix[0] = static_cast<uint8_t>(sig.size()), prefix_size = 1;
+	}
+	else if (sig.size() <= UINT8_MAX) {
+		prefix[0] = Script::OP_PUSHDATA1, prefix[1] = static_cast<uint8_t>(sig.size()), prefix_size = 2;
+	}
+	else if (sig.size() <= UINT16_MAX) {
+		prefix[0] = Script::OP_PUSHDATA2, as_le(*reinterpret_cast<uint16_t *>(prefix + 1)) = static_cast<uint16_t>(sig.size()), prefix_size = 3;
+	}
+	else {
+		prefix[0] = Script::OP_PUSHDATA4, as_le(*reinterpret_cast<uint32_t *>(prefix + 1)) = static_cast<uint32_t>(sig.size()), prefix_size = 5;
+	}
+	size_t pattern_size = prefix_size + sig.size();
+	auto matches = [&](const uint8_t *p) {
+		return static_cast<size_t>(script_code.end() - p) >= pattern_size && std::memcmp(p, prefix, prefix_size) == 0 && std::memcmp(p + prefix_size, sig.data(), sig.size()) == 0;
+	};
+	uint8_t *out = nullptr, *out_begin = nullptr;
+	auto pc = script_code.begin(), end = script_code.end(), kept = pc;
+	for (;;) {
+		if (matches(pc)) {
+			if (!out) {
+				out = out_begin = static_cast<uint8_t *>(interp.arena.allocate(script_code.size(), 1));
+			}
+			std::memcpy(out, kept, pc - kept), out += pc - kept;
+			do {
+				pc += pattern_size;
+			} while (matches(pc));
+			kept = pc;
+		}
+		Script::Opcode opcode;
+		Element data;
+		if (!read_op(pc, end, opcode, data)) {
+			break;
+		}
+	}
+	if (!out) {
+		return script_code;
+	}
+	std::memcpy(out, kept, end - kept), out += end - kept;
+	return { out_begin, static_cast<size_t>(out - out_begin) };
+}
+
+
+typedef ScriptError (*Handler)(Interpreter::Machine &, Script::Opcode);
+
+#define HANDLER(name) static ScriptError name([[gnu::unused]] Interpreter::Machine &m, [[gnu::unused]] Script::Opcode opcode)
+#define REQUIRE_DEPTH(n) do { if (m.depth() < (n)) return ScriptError::INVALID_STACK_OPERATION; } while (0)
+#define PUSH(e) do { if (!m.push(e)) return ScriptError::STACK_SIZE; } while (0)
+
+HANDLER(op_bad) {
+	return ScriptError::BAD_OPCODE;
+}
+
+HANDLER(op_push_num) {
+	PUSH(Element(&small_ints[opcode == Script::OP_1NEGATE ? 0 : opcode - (Script::OP_1 - 1)], 1));
+	return ScriptError::OK;
+}
+
+HANDLER(op_nop) {
+	return ScriptError::OK;
+}
+
+HANDLER(op_if) {
+	bool value = false;
+	if (m.conditions.all_true()) {
+		if (m.depth() < 1) {
+			return ScriptError::UNBALANCED_CONDITIONAL;
+		}
+		value = cast_to_bool(m.top());
+		if (opcode == Script::OP_NOTIF) {
+			value = !value;
+		}
+		m.pop();
+	}
+	m.conditions.push(value);
+	return ScriptError::OK;
+}
+
+HANDLER(op_else) {
+	if (m.conditions.empty()) {
+		return ScriptError::UNBALANCED_CONDITIONAL;
+	}
+	m.conditions.toggle_top();
+	return ScriptError::OK;
+}
+
+HANDLER(op_endif) {
+	if (m.conditions.empty()) {
+		return ScriptError::UNBALANCED_CONDITIONAL;
+	}
+	m.conditions.pop();
+	return ScriptError::OK;
+}
+
+HANDLER(op_verify) {
+	REQUIRE_DEPTH(1);
+	if (!cast_to_bool(m.top())) {
+		return ScriptError::VERIFY;
+	}
+	m.pop();
+	return ScriptError::OK;
+}
+
+HANDLER(op_return) {
+	return ScriptError::OP_RETURN;
+}
+
+HANDLER(op_checklocktimeverify) {
+	if (!m.has(ScriptFlags::VERIFY_CHECKLOCKTIMEVERIFY)) {
+		return ScriptError::OK;
+	}
+	REQUIRE_DEPTH(1);
+	int64_t lock_time;
+	if (!m.get_num(m.top(), lock_time, 5)) {
+		return ScriptError::INVALID_NUMBER;
+	}
+	if (lock_time < 0) {
+		return ScriptError::NEGATIVE_LOCKTIME;
+	}
+	return m.checker.check_lock_time(lock_time) ? ScriptError::OK : ScriptError::UNSATISFIED_LOCKTIME;
+}
+
+HANDLER(op_checksequenceverify) {
+	if (!m.has(ScriptFlags::VERIFY_CHECKSEQUENCEVERIFY)) {
+		return ScriptError::OK;
+	}
+	REQUIRE_DEPTH(1);
+	int64_t sequence;
+	if (!m.get_num(m.top(), sequence, 5)) {
+		return ScriptError::INVALID_NUMBER;
+	}
+	if (sequence < 0) {
+		return ScriptError::NEGATIVE_LOCKTIME;
+	}
+	if (sequence & INT64_C(1) << 31) { // disable flag
+		return ScriptError::OK;
+	}
+	return m.checker.check_sequence(sequence) ? ScriptError::OK : ScriptError::UNSATISFIED_LOCKTIME;
+}
+
+HANDLER(op_toaltstack) {
+	REQUIRE_DEPTH(1);
+	auto &alt = m.altstack();
+	if (alt.size == Interpreter::max_stack_size) {
+		return ScriptError::STACK_SIZE;
+	}
+	alt.items[alt.size++] = m.top();
+	m.pop();
+	return ScriptError::OK;
+}
+
+HANDLER(op_fromaltstack) {
+	auto &alt = m.altstack();
+	if (alt.size < 1) {
+		return ScriptError::INVALID_ALTSTACK_OPERATION;
+	}
+	PUSH(alt.items[--alt.size]);
+	return ScriptError::OK;
+}
+
+HANDLER(op_2drop) {
+	REQUIRE_DEPTH(2);
+	m.pop(2);
+	return ScriptError::OK;
+}
+
+HANDLER(op_2dup) {
+	REQUIRE_DEPTH(2);
+	auto a = m.top(2), b = m.top(1);
+	PUSH(a);
+	PUSH(b);
+	return ScriptError::OK;
+}
+
+HANDLER(op_3dup) {
+	REQUIRE_DEPTH(3);
+	auto a = m.top(3), b = m.top(2), c = m.top(1);
+	PUSH(a);
+	PUSH(b);
+	PUSH(c);
+	return ScriptError::OK;
+}
+
+HANDLER(op_2over) {
+	REQUIRE_DEPTH(4);
+	auto a = m.top(4), b = m.top(3);
+	PUSH(a);
+	PUSH(b);
+	return ScriptError::OK;
+}
+
+HANDLER(op_2rot) {
+	REQUIRE_DEPTH(6);
+	auto a = m.top(6), b = m.top(5);
+	auto items = &m.top(6);
+	std::memmove(items, items + 2, 4 * sizeof *items);
+	m.top(2) = a, m.top(1) = b;
+	return ScriptError::OK;
+}
+
+HANDLER(op_2swap) {
+	REQUIRE_DEPTH(4);
+	std::swap(m.top(4), m.top(2));
+	std::swap(m.top(3), m.top(1));
+	return ScriptError::OK;
+}
+
+HANDLER(op_ifdup) {
+	REQUIRE_DEPTH(1);
+	if (cast_to_bool(m.top())) {
+		PUSH(m.top());
+	}
+	return ScriptError::OK;
+}
+
+HANDLER(op_depth) {
+	PUSH(m.make_num(static_cast<int64_t>(m.depth())));
+	return ScriptError::OK;
+}
+
+HANDLER(op_drop) {
+	REQUIRE_DEPTH(1);
+	m.pop();
+	return ScriptError::OK;
+}
+
+HANDLER(op_dup) {
+	REQUIRE_DEPTH(1);
+	PUSH(m.top());
+	return ScriptError::OK;
+}
+
+HANDLER(op_nip) {
+	REQUIRE_DEPTH(2);
+	m.top(2) = m.top(1);
+	m.pop();
+	return ScriptError::OK;
+}
+
+HANDLER(op_over) {
+	REQUIRE_DEPTH(2);
+	PUSH(m.top(2));
+	return ScriptError::OK;
+}
+
+HANDLER(op_pick_roll) {
+	REQUIRE_DEPTH(2);
+	int64_t n;
+	if (!m.get_num(m.top(), n)) {
+		return ScriptError::INVALID_NUMBER;
+	}
+	m.pop();
+	if (n < 0 || static_cast<uint64_t>(n) >= m.depth()) {
+		return ScriptError::INVALID_STACK_OPERATION;
+	}
+	auto idx = static_cast<size_t>(n) + 1;
+	auto element = m.top(idx);
+	if (opcode == Script::OP_ROLL) {
+		auto items = &m.top(idx);
+		std::memmove(items, items + 1, (idx - 1) * sizeof *items);
+		m.pop();
+	}
+	PUSH(element);
+	return ScriptError::OK;
+}
+
+HANDLER(op_rot) {
+	REQUIRE_DEPTH(3);
+	std::swap(m.top(3), m.top(2));
+	std::swap(m.top(2), m.top(1));
+	return ScriptError::OK;
+}
+
+HANDLER(op_swap) {
+	REQUIRE_DEPTH(2);
+	std::swap(m.top(2), m.top(1));
+	return ScriptError::OK;
+}
+
+HANDLER(op_tuck) {
+	REQUIRE_DEPTH(2);
+	auto a = m.top(2), b = m.top(1);
+	m.top(2) = b, m.top(1) = a;
+	PUSH(b);
+	return ScriptError::OK;
+}
+
+HANDLER(op_size) {
+	REQUIRE_DEPTH(1);
+	PUSH(m.make_num(static_cast<int64_t>(m.top().size())));
+	return ScriptError::OK;
+}
+
+HANDLER(op_equal) {
+	REQUIRE_DEPTH(2);
+	auto a = m.top(2), b = m.top(1);
+	bool equal = a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size()) == 0;
+	m.pop(2);
+	if (opcode == Script::OP_EQUALVERIFY) {
+		return equal ? ScriptError::OK : ScriptError::EQUALVERIFY;
+	}
+	PUSH(equal ? element_true : element_false);
+	return ScriptError::OK;
+}
+
+HANDLER(op_unary_num) {
+	REQUIRE_DEPTH(1);
+	int64_t n;
+	if (!m.get_num(m.top(), n)) {
+		return ScriptError::INVALID_NUMBER;
+	}
+	switch (opcode) {
+		case Script::OP_1ADD: ++n; break;
+		case Script::OP_1SUB: --n; break;
+		case Script::OP_NEGATE: n = -n; break;
+		case Script::OP_ABS: n = n < 0 ? -n : n; break;
+		case Script::OP_NOT: n = n == 0; break;
+		case Script::OP_0NOTEQUAL: n = n != 0; break;
+		default: return ScriptError::BAD_OPCODE;
+	}
+	m.top() = m.make_num(n);
+	return ScriptError::OK;
+}
+
+HANDLER(op_binary_num) {
+	REQUIRE_DEPTH(2);
+	int64_t a, b;
+	if (!m.get_num(m.top(2), a) || !m.get_num(m.top(1), b)) {
+		return ScriptError::INVALID_NUMBER;
+	}
+	int64_t n;
+	switch (opcode) {
+		case Script::OP_ADD: n = a + b; break;
+		case Script::OP_SUB: n = a - b; break;
+		case Script::OP_BOOLAND: n = a != 0 && b != 0; break;
+		case Script::OP_BOOLOR: n = a != 0 || b != 0; break;
+		case Script::OP_NUMEQUAL: case Script::OP_NUMEQUALVERIFY: n = a == b; break;
+		case Script::OP_NUMNOTEQUAL: n = a != b; break;
+		case Script::OP_LESSTHAN: n = a < b; break;
+		case Script::OP_GREATERTHAN: n = a > b; break;
+		case Script::OP_LESSTHANOREQUAL: n = a <= b; break;
+		case Script::OP_GREATERTHANOREQUAL: n = a >= b; break;
+		case Script::OP_MIN: n = a < b ? a : b; break;
+		case Script::OP_MAX: n = a > b ? a : b; break;
+		default: return ScriptError::BAD_OPCODE;
+	}
+	m.pop(2);
+	if (opcode == Script::OP_NUMEQUALVERIFY) {
+		return n ? ScriptError::OK : ScriptError::NUMEQUALVERIFY;
+	}
+	PUSH(m.make_num(n));
+	return ScriptError::OK;
+}
+
+HANDLER(op_within) {
+	REQUIRE_DEPTH(3);
+	int64_t x, min, max;
+	if (!m.get_num(m.top(3), x) || !m.get_num(m.top(2), min) || !m.get_num(m.top(1), max)) {
+		return ScriptError::INVALID_NUMBER;
+	}
+	m.pop(3);
+	PUSH(min <= x && x < max ? element_true : element_false);
+	return ScriptError::OK;
+}
+
+HANDLER(op_hash) {
+	REQUIRE_DEPTH(1);
+	auto element = m.top();
+	switch (opcode) {
+		case Script::OP_RIPEMD160: {
+			RIPEMD160 rmd;
+			rmd.write_fully(element.data(), element.size());
+			m.top() = m.copy(rmd.digest().data(), RIPEMD160::digest_size);
+			break;
+		}
+		case Script::OP_SHA1: {
+			SHA1 sha;
+			sha.write_fully(element.data(), element.size());
+			m.top() = m.copy(sha.digest().data(), SHA1::digest_size);
+			break;
+		}
+		case Script::OP_SHA256: {
+			SHA256 sha;
+			sha.write_fully(element.data(), element.size());
+			m.top() = m.copy(sha.digest().data(), SHA256::digest_size);
+			break;
+		}
+		case Script::OP_HASH160: {
+			SHA256 sha;
+			sha.write_fully(element.data(), element.size());
+			RIPEMD160 rmd;
+			rmd.write_fully(sha.digest().data(), SHA256::digest_size);
+			m.top() = m.copy(rmd.digest().data(), RIPEMD160::digest_size);
+			break;
+		}
+		case Script::OP_HASH256: {
+			SHA256 isha, osha;
+			isha.write_fully(element.data(), element.size());
+			osha.write_fully(isha.digest().data(), SHA256::digest_size);
+			m.top() = m.copy(osha.digest().data(), SHA256::digest_size);
+			break;
+		}
+		default:
+			return ScriptError::BAD_OPCODE;
+	}
+	return ScriptError::OK;
+}
+
+HANDLER(op_codeseparator) {
+	// m.code_begin is advanced by the main loop, which knows the position
+	return ScriptError::OK;
+}
+
+HANDLER(op_checksig) {
+	REQUIRE_DEPTH(2);
+	auto sig = m.top(2), pubkey = m.top(1);
+	auto script_code = m.find_and_delete(Element(m.code_begin, m.end - m.code_begin), sig);
+	auto error = m.check_signature_encoding(sig);
+	if (error != ScriptError::OK) {
+		return error;
+	}
+	bool success = !sig.empty() && m.checker.check_sig(sig, pubkey, script_code);
+	m.pop(2);
+	if (opcode == Script::OP_CHECKSIGVERIFY) {
+		return success ? ScriptError::OK : ScriptError::CHECKSIGVERIFY;
+	}
+	PUSH(success ? element_true : element_false);
+	return ScriptError::OK;
+}
+
+HANDLER(op_checkmultisig) {
+	size_t i = 1;
+	REQUIRE_DEPTH(i);
+	int64_t n_keys;
+	if (!m.get_num(m.top(i), n_keys)) {
+		return ScriptError::INVALID_NUMBER;
+	}
+	if (n_keys < 0 || n_keys > static_cast<int64_t>(Interpreter::max_pubkeys)) {
+		return ScriptError::PUBKEY_COUNT;
+	}
+	if ((m.op_count += static_cast<size_t>(n_keys)) > Interpreter::max_ops) {
+		return ScriptError::OP_COUNT;
+	}
+	size_t ikey = ++i;
+	i += static_cast<size_t>(n_keys);
+	REQUIRE_DEPTH(i);
+	int64_t n_sigs;
+	if (!m.get_num(m.top(i), n_sigs)) {
+		return ScriptError::INVALID_NUMBER;
+	}
+	if (n_sigs < 0 || n_sigs > n_keys) {
+		return ScriptError::SIG_COUNT;
+	}
+	size_t isig = ++i;
+	i += static_cast<size_t>(n_sigs);
+	REQUIRE_DEPTH(i);
+	Element script_code(m.code_begin, m.end - m.code_begin);
+	for (size_t k = 0; k < static_cast<size_t>(n_sigs); ++k) {
+		script_code = m.find_and_delete(script_code, m.top(isig + k));
+	}
+	bool success = true;
+	while (success && n_sigs > 0) {
+		auto sig = m.top(isig), pubkey = m.top(ikey);
+		auto error = m.check_signature_encoding(sig);
+		if (error != ScriptError::OK) {
+			return error;
+		}
+		if (!sig.empty() && m.checker.check_sig(sig, pubkey, script_code)) {
+			++isig, --n_sigs;
+		}
+		++ikey, --n_keys;
+		if (n_sigs > n_keys) {
+			success = false;
+		}
+	}
+	m.pop(i - 1);
+	// an extra element is consumed, preserved from the original implementation
+	REQUIRE_DEPTH(1);
+	if (m.has(ScriptFlags::VERIFY_NULLDUMMY) && !m.top().empty()) {
+		return ScriptError::SIG_NULLDUMMY;
+	}
+	m.pop();
+	if (opcode == Script::OP_CHECKMULTISIGVERIFY) {
+		return success ? ScriptError::OK : ScriptError::CHECKMULTISIGVERIFY;
+	}
+	PUSH(success ? element_true : element_false);
+	return ScriptError::OK;
+}
+
+#undef PUSH
+#undef REQUIRE_DEPTH
+#undef HANDLER
+
+
+static const struct DispatchTable {
+	Handler handlers[256];
+	DispatchTable() {
+		for (auto &handler : handlers) {
+			handler = &op_bad;
+		}
+		handlers[Script::OP_1NEGATE] = &op_push_num;
+		for (unsigned op = Script::OP_1; op <= Script::OP_16; ++op) {
+			handlers[op] = &op_push_num;
+		}
+		handlers[Script::OP_NOP] = &op_nop;
+		handlers[Script::OP_IF] = handlers[Script::OP_NOTIF] = &op_if;
+		handlers[Script::OP_ELSE] = &op_else;
+		handlers[Script::OP_ENDIF] = &op_endif;
+		handlers[Script::OP_VERIFY] = &op_verify;
+		handlers[Script::OP_RETURN] = &op_return;
+		handlers[Script::OP_TOALTSTACK] = &op_toaltstack;
+		handlers[Script::OP_FROMALTSTACK] = &op_fromaltstack;
+		handlers[Script::OP_2DROP] = &op_2drop;
+		handlers[Script::OP_2DUP] = &op_2dup;
+		handlers[Script::OP_3DUP] = &op_3dup;
+		handlers[Script::OP_2OVER] = &op_2over;
+		handlers[Script::OP_2ROT] = &op_2rot;
+		handlers[Script::OP_2SWAP] = &op_2swap;
+		handlers[Script::OP_IFDUP] = &op_ifdup;
+		handlers[Script::OP_DEPTH] = &op_depth;
+		handlers[Script::OP_DROP] = &op_drop;
+		handlers[Script::OP_DUP] = &op_dup;
+		handlers[Script::OP_NIP] = &op_nip;
+		handlers[Script::OP_OVER] = &op_over;
+		handlers[Script::OP_PICK] = handlers[Script::OP_ROLL] = &op_pick_roll;
+		handlers[Script::OP_ROT] = &op_rot;
+		handlers[Script::OP_SWAP] = &op_swap;
+		handlers[Script::OP_TUCK] = &op_tuck;
+		handlers[Script::OP_SIZE] = &op_size;
+		handlers[Script::OP_EQUAL] = handlers[Script::OP_EQUALVERIFY] = &op_equal;
+		for (auto op : { Script::OP_1ADD, Script::OP_1SUB, Script::OP_NEGATE, Script::OP_ABS, Script::OP_NOT, Script::OP_0NOTEQUAL }) {
+			handlers[op] = &op_unary_num;
+		}
+		for (unsigned op = Script::OP_ADD; op <= Script::OP_MAX; ++op) {
+			handlers[op] = &op_binary_num;
+		}
+		handlers[Script::OP_MUL] = handlers[Script::OP_DIV] = handlers[Script::OP_MOD] = &op_bad;
+		handlers[Script::OP_LSHIFT] = handlers[Script::OP_RSHIFT] = &op_bad;
+		handlers[Script::OP_WITHIN] = &op_within;
+		for (unsigned op = Script::OP_RIPEMD160; op <= Script::OP_HASH256; ++op) {
+			handlers[op] = &op_hash;
+		}
+		handlers[Script::OP_CODESEPARATOR] = &op_codeseparator;
+		handlers[Script::OP_CHECKSIG] = handlers[Script::OP_CHECKSIGVERIFY] = &op_checksig;
+		handlers[Script::OP_CHECKMULTISIG] = handlers[Script::OP_CHECKMULTISIGVERIFY] = &op_checkmultisig;
+		handlers[Script::OP_NOP1] = &op_nop;
+		handlers[Script::OP_CHECKLOCKTIMEVERIFY] = &op_checklocktimeverify;
+		handlers[Script::OP_NOP3] = &op_checksequenceverify;
+		for (unsigned op = Script::OP_NOP4; op <= Script::OP_NOP10; ++op) {
+			handlers[op] = &op_nop;
+		}
+	}
+} dispatch;
+
+static bool is_disabled(Script::Opcode opcode) {
+	switch (opcode) {
+		case Script::OP_CAT:
+		case Script::OP_SUBSTR:
+		case Script::OP_LEFT:
+		case Script::OP_RIGHT:
+		case Script::OP_INVERT:
+		case Script::OP_AND:
+		case Script::OP_OR:
+		case Script::OP_XOR:
+		case Script::OP_2MUL:
+		case Script::OP_2DIV:
+		case Script::OP_MUL:
+		case Script::OP_DIV:
+		case Script::OP_MOD:
+		case Script::OP_LSHIFT:
+		case Script::OP_RSHIFT:
+			return true;
+		default:
+			return false;
+	}
+}
+
+ScriptError Interpreter::Machine::run() {
+	if (static_cast<size_t>(end - code_begin) > max_script_size) {
+		return ScriptError::SCRIPT_SIZE;
+	}
+	bool minimal = this->has(ScriptFlags::VERIFY_MINIMALDATA);
+	for (auto &op : script) {
+		auto opcode = op.opcode;
+		auto data = script.data(op);
+		if (data.size() > max_element_size) {
+			return ScriptError::PUSH_SIZE;
+		}
+		if (opcode > Script::OP_16 && ++op_count > max_ops) {
+			return ScriptError::OP_COUNT;
+		}
+		if (is_disabled(opcode)) {
+			return ScriptError::DISABLED_OPCODE;
+		}
+		bool exec = conditions.all_true();
+		if (opcode <= Script::OP_PUSHDATA4) {
+			if (exec) {
+				if (minimal && !is_minimal_push(opcode, data)) {
+					return ScriptError::MINIMALDATA;
+				}
+				if (!this->push(data)) {
+					return ScriptError::STACK_SIZE;
+				}
+			}
+		}
+		else if (exec || Script::OP_IF <= opcode && opcode <= Script::OP_ENDIF) {
+			auto error = dispatch.handlers[opcode](*this, opcode);
+			if (error != ScriptError::OK) {
+				return error;
+			}
+			if (opcode == Script::OP_CODESEPARATOR) {
+				code_begin = script.rest(op).begin();
+			}
+		}
+		if (interp.stack.size + interp.altstack.size > max_stack_size) {
+			return ScriptError::STACK_SIZE;
+		}
+	}
+	if (!script.valid()) {
+		return ScriptError::BAD_OPCODE;
+	}
+	return conditions.empty() ? ScriptError::OK : ScriptError::UNBALANCED_CONDITIONAL;
+}
+
+
+ScriptError Interpreter::eval(const DecodedScript &script, ScriptFlags flags, const SignatureChecker &checker) {
+	altstack.size = 0;
+	return Machine(*this, script, flags, checker).run();
+}
+
+ScriptError Interpreter::eval(Span<const uint8_t> script, ScriptFlags flags, const SignatureChecker &checker) {
+	decoded_sig.decode(script);
+	return this->eval(decoded_sig, flags, checker);
+}
+
+ScriptError Interpreter::verify(Span<const uint8_t> script_sig, Span<const uint8_t> script_pubkey, ScriptFlags flags, const SignatureChecker &checker) {
+	decoded_sig.decode(script_sig);
+	decoded_pubkey.decode(script_pubkey);
+	return this->verify(decoded_sig, decoded_pubkey, flags, checker);
+}
+
+ScriptError Interpreter::verify(const DecodedScript &script_sig, const DecodedScript &script_pubkey, ScriptFlags flags, const SignatureChecker &checker) {
+	this->clear();
+	auto error = this->eval(script_sig, flags, checker);
+	if (error != ScriptError::OK) {
+		return error;
+	}
+	bool p2sh = (flags & ScriptFlags::VERIFY_P2SH) != ScriptFlags::NONE && is_pay_to_script_hash(script_pubkey.script());
+	if (p2sh) {
+		saved.size = stack.size;
+		std::copy(stack.items, stack.items + stack.size, saved.items);
+	}
+	if ((error = this->eval(script_pubkey, flags, checker)) != ScriptError::OK) {
+		return error;
+	}
+	if (stack.size == 0 || !cast_to_bool(stack.items[stack.size - 1])) {
+		return ScriptError::EVAL_FALSE;
+	}
+	if (p2sh) {
+		if (!script_sig.push_only()) {
+			return ScriptError::SIG_PUSHONLY;
+		}
+		stack.size = saved.size;
+		std::copy(saved.items, saved.items + saved.size, stack.items);
+		decoded_redeem.decode(stack.items[--stack.size]);
+		if ((error = this->eval(decoded_redeem, flags, checker)) != ScriptError::OK) {
+			return error;
+		}
+		if (stack.size == 0 || !cast_to_bool(stack.items[stack.size - 1])) {
+			return ScriptError::EVAL_FALSE;
+		}
+	}
+	return ScriptError::OK;
+}
+
+void Interpreter::clear() {
+	stack.size = altstack.size = saved.size = 0;
+	arena.reset();
+}
+
+
+} // namespace satoshi
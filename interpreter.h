@@ -0,0 +1,138 @@
+#pragma once
+
+#include <iosfwd>
+
+#include "arena.h"
+#include "script.h"
+#include "span.h"
+#include "common/enumflags.h"
+
+
+namespace satoshi {
+
+
+enum class ScriptFlags : uint32_t {
+	NONE = 0,
+	VERIFY_P2SH = 1 << 0, // BIP 16
+	VERIFY_DERSIG = 1 << 2, // BIP 66
+	VERIFY_NULLDUMMY = 1 << 4, // BIP 147
+	VERIFY_MINIMALDATA = 1 << 6,
+	VERIFY_CHECKLOCKTIMEVERIFY = 1 << 9, // BIP 65
+	VERIFY_CHECKSEQUENCEVERIFY = 1 << 10, // BIP 112
+};
+
+DEFINE_ENUM_FLAG_OPS(ScriptFlags)
+
+
+enum class ScriptError : uint8_t {
+	OK,
+	UNKNOWN,
+	EVAL_FALSE,
+	OP_RETURN,
+	SCRIPT_SIZE,
+	PUSH_SIZE,
+	OP_COUNT,
+	STACK_SIZE,
+	SIG_COUNT,
+	PUBKEY_COUNT,
+	INVALID_NUMBER,
+	VERIFY,
+	EQUALVERIFY,
+	CHECKMULTISIGVERIFY,
+	CHECKSIGVERIFY,
+	NUMEQUALVERIFY,
+	BAD_OPCODE,
+	DISABLED_OPCODE,
+	INVALID_STACK_OPERATION,
+	INVALID_ALTSTACK_OPERATION,
+	UNBALANCED_CONDITIONAL,
+	NEGATIVE_LOCKTIME,
+	UNSATISFIED_LOCKTIME,
+	MINIMALDATA,
+	SIG_DER,
+	SIG_NULLDUMMY,
+	SIG_PUSHONLY,
+};
+
+std::ostream & operator << (std::ostream &os, ScriptError error);
+
+
+// Supplies everything the interpreter needs to know about the spending
+// transaction. The defaults reject every signature and lock time.
+class SignatureChecker {
+
+public:
+	virtual ~SignatureChecker() { }
+
+public:
+	virtual bool check_sig(Span<const uint8_t> sig, Span<const uint8_t> pubkey, Span<const uint8_t> script_code) const;
+	virtual bool check_lock_time(int64_t lock_time) const;
+	virtual bool check_sequence(int64_t sequence) const;
+
+};
+
+
+// Legacy (pre-segwit) script interpreter. Stack elements are views into the
+// scripts being run or into an internal arena that is rewound for every
+// verification, so a long-lived interpreter does not touch the heap. An
+// interpreter is large and is meant to be reused, one per thread.
+class Interpreter {
+
+public:
+	static constexpr size_t max_script_size = 10000;
+	static constexpr size_t max_element_size = 520;
+	static constexpr size_t max_ops = 201;
+	static constexpr size_t max_stack_size = 1000;
+	static constexpr size_t max_pubkeys = 20;
+
+	typedef Span<const uint8_t> Element;
+
+private:
+	struct Stack {
+		size_t size;
+		Element items[max_stack_size];
+	};
+
+private:
+	Arena arena;
+	Stack stack, altstack, saved;
+	DecodedScript decoded_sig, decoded_pubkey, decoded_redeem;
+
+public:
+	Interpreter() : arena(size_t(1) << 14) { stack.size = altstack.size = saved.size = 0; }
+
+	Interpreter(const Interpreter &) = delete;
+	Interpreter & operator = (const Interpreter &) = delete;
+
+public:
+	ScriptError verify(Span<const uint8_t> script_sig, Span<const uint8_t> script_pubkey, ScriptFlags flags, const SignatureChecker &checker);
+	// for callers that keep frequently spent scripts decoded
+	ScriptError verify(const DecodedScript &script_sig, const DecodedScript &script_pubkey, ScriptFlags flags, const SignatureChecker &checker);
+	ScriptError verify(const Script &script_sig, const Script &script_pubkey, ScriptFlags flags, const SignatureChecker &checker) {
+		return this->verify(Span<const uint8_t>(script_sig.data(), script_sig.size()), Span<const uint8_t>(script_pubkey.data(), script_pubkey.size()), flags, checker);
+	}
+
+	// Runs a single script against the current stack.
+	ScriptError eval(Span<const uint8_t> script, ScriptFlags flags, const SignatureChecker &checker);
+	ScriptError eval(const DecodedScript &script, ScriptFlags flags, const SignatureChecker &checker);
+
+	void clear();
+	Span<const Element> elements() const { return { stack.items, stack.size }; }
+
+public:
+	struct Machine; // evaluation state, private to the implementation
+
+};
+
+
+bool cast_to_bool(Span<const uint8_t> element) _pure;
+
+// BIP 66 strict DER, including the trailing sighash type byte
+bool is_valid_signature_encoding(Span<const uint8_t> sig) _pure;
+
+bool is_push_only(Span<const uint8_t> script) _pure;
+
+bool is_pay_to_script_hash(Span<const uint8_t> script) _pure;
+
+
+} // namespace satoshi
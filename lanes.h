@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+// Vector code is written once with GCC's generic vector types and inlined into
+// one function per instruction set, which then compiles it for registers of
+// that width; select_lanes() picks among those functions at run time.
+//
+// Vectors are never passed or returned by value, not even between inlined
+// helpers, which instead update them through references. GCC flags any such
+// helper with -Wpsabi, as its ABI would depend on the target, and reports it
+// at the end of the file, where no diagnostic pragma can reach.
+#define _lane_inline inline __attribute__((__always_inline__))
+
+template <size_t N>
+struct Lanes {
+	typedef uint32_t Vector __attribute__((__vector_size__(N * 4)));
+};
+
+typedef uint8_t Bytes16 __attribute__((__vector_size__(16)));
+typedef uint8_t Bytes32 __attribute__((__vector_size__(32)));
+typedef uint64_t Words4 __attribute__((__vector_size__(32)));
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#define LANES_X86 1
+
+// The widest of the functions given that the CPU can run, each being null if
+// there is none for that instruction set. Elsewhere only the generic one is
+// built, and is used as is.
+template <typename F>
+static inline F select_lanes(F generic, decltype(generic) ssse3, decltype(generic) avx2, decltype(generic) avx512) {
+	if (avx512 && __builtin_cpu_supports("avx512f")) {
+		return avx512;
+	}
+	if (avx2 && __builtin_cpu_supports("avx2")) {
+		return avx2;
+	}
+	if (ssse3 && __builtin_cpu_supports("ssse3")) {
+		return ssse3;
+	}
+	return generic;
+}
+
+#endif
@@ -0,0 +1,117 @@
+#include "orphans.h"
+
+#include <algorithm>
+
+#include "common/serial.h"
+
+
+namespace satoshi {
+
+
+constexpr size_t OrphanPool::default_max_count;
+constexpr size_t OrphanPool::default_max_bytes;
+constexpr size_t OrphanPool::max_tx_size;
+
+static size_t serialized_size(const Tx &tx) {
+	struct _hidden CountingSink : Sink {
+		size_t length;
+		CountingSink() : length() { }
+		size_t write(const void *, size_t n) override { length += n; return n; }
+	} sink;
+	sink << tx;
+	return sink.length;
+}
+
+OrphanPool::OrphanPool(size_t max_count, size_t max_bytes) : max_count(max_count), max_bytes(max_bytes), bytes(), rng(std::random_device()()), orphans(0, DigestHash(rng())), by_parent(0, DigestHash(rng())) {
+	slots.reserve(max_count + 1);
+}
+
+const Tx * OrphanPool::find(const digest256_t &hash) const {
+	auto itr = orphans.find(hash);
+	return itr == orphans.end() ? nullptr : &itr->second.tx;
+}
+
+bool OrphanPool::insert(const digest256_t &hash, Tx &&tx) {
+	auto size = serialized_size(tx);
+	if (size > max_tx_size || size > max_bytes || orphans.find(hash) != orphans.end()) {
+		return false;
+	}
+	auto &entry = orphans.emplace(hash, Entry { std::move(tx), size, slots.size() }).first->second;
+	slots.push_back(hash);
+	bytes += size;
+	for (auto &txin : entry.tx.inputs) {
+		auto &children = by_parent[txin.prevout.tx_hash];
+		if (children.empty() || children.back() != hash) {
+			children.push_back(hash);
+		}
+	}
+	while (orphans.size() > max_count || bytes > max_bytes) {
+		this->evict_random();
+	}
+	return true;
+}
+
+bool OrphanPool::erase(const digest256_t &hash) {
+	auto itr = orphans.find(hash);
+	if (itr == orphans.end()) {
+		return false;
+	}
+	this->unlink(hash, itr->second);
+	orphans.erase(itr);
+	return true;
+}
+
+void OrphanPool::clear() {
+	orphans.clear();
+	by_parent.clear();
+	slots.clear();
+	bytes = 0;
+}
+
+std::vector<Tx> OrphanPool::resolve(const digest256_t &parent_hash) {
+	std::vector<Tx> ret;
+	auto parent_itr = by_parent.find(parent_hash);
+	if (parent_itr == by_parent.end()) {
+		return ret;
+	}
+	auto children = std::move(parent_itr->second);
+	by_parent.erase(parent_itr);
+	ret.reserve(children.size());
+	for (auto &child_hash : children) {
+		auto itr = orphans.find(child_hash);
+		if (itr != orphans.end()) {
+			this->unlink(child_hash, itr->second);
+			ret.push_back(std::move(itr->second.tx));
+			orphans.erase(itr);
+		}
+	}
+	return ret;
+}
+
+void OrphanPool::unlink(const digest256_t &hash, const Entry &entry) {
+	for (auto &txin : entry.tx.inputs) {
+		auto parent_itr = by_parent.find(txin.prevout.tx_hash);
+		if (parent_itr != by_parent.end()) {
+			auto &children = parent_itr->second;
+			children.erase(std::remove(children.begin(), children.end(), hash), children.end());
+			if (children.empty()) {
+				by_parent.erase(parent_itr);
+			}
+		}
+	}
+	auto &last = slots.back();
+	if (entry.slot != slots.size() - 1) {
+		orphans.find(last)->second.slot = entry.slot;
+		slots[entry.slot] = last;
+	}
+	slots.pop_back();
+	bytes -= entry.size;
+}
+
+void OrphanPool::evict_random() {
+	auto hash = slots[std::uniform_int_distribution<size_t>(0, slots.size() - 1)(rng)];
+	this->erase(hash);
+}
+
+
+} // namespace satoshi
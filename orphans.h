@@ -0,0 +1,62 @@
+#pragma once
+
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "blockchain.h"
+
+
+namespace satoshi {
+
+
+class OrphanPool {
+
+public:
+	static constexpr size_t default_max_count = 100;
+	static constexpr size_t default_max_bytes = 5000000;
+	static constexpr size_t max_tx_size = 100000;
+
+private:
+	struct Entry {
+		Tx tx;
+		size_t size;
+		size_t slot; // position in `slots`
+	};
+
+private:
+	size_t max_count, max_bytes, bytes;
+	std::mt19937_64 rng;
+	std::unordered_map<digest256_t, Entry, DigestHash> orphans;
+	std::unordered_map<digest256_t, std::vector<digest256_t>, DigestHash> by_parent;
+	std::vector<digest256_t> slots;
+
+public:
+	explicit OrphanPool(size_t max_count = default_max_count, size_t max_bytes = default_max_bytes);
+
+public:
+	size_t size() const { return orphans.size(); }
+	size_t size_bytes() const { return bytes; }
+	bool contains(const digest256_t &hash) const { return orphans.find(hash) != orphans.end(); }
+	const Tx * find(const digest256_t &hash) const _pure;
+
+	// Returns false if the transaction is too large or already present. May evict
+	// randomly chosen orphans (possibly including the one just inserted) to stay
+	// within the count and byte limits.
+	bool insert(const digest256_t &hash, Tx &&tx);
+	bool insert(Tx &&tx) { auto hash = tx_hash(tx); return this->insert(hash, std::move(tx)); }
+
+	bool erase(const digest256_t &hash);
+	void clear();
+
+	// Removes and returns every orphan that spends an output of the given parent.
+	std::vector<Tx> resolve(const digest256_t &parent_hash);
+
+private:
+	void unlink(const digest256_t &hash, const Entry &entry);
+	void evict_random();
+
+};
+
+
+} // namespace satoshi
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+
+namespace satoshi {
+
+
+// Calls f(begin, end) over [0, n) in ranges of grain elements, the last
+// perhaps shorter. Ranges are handed out one at a time, so a thread held up by
+// a slow range leaves the rest to the others. Zero threads means one per
+// hardware thread, and there are never more threads than whole ranges; the
+// calling thread is one of them. A grain of zero is taken as one. Once f
+// throws, no more ranges are handed out, and the first exception is rethrown
+// on the calling thread after the others have finished theirs.
+template <typename F>
+static inline void parallel_ranges(size_t n, size_t grain, unsigned n_threads, F f) {
+	grain = std::max<size_t>(grain, 1);
+	if (n_threads == 0 && (n_threads = std::thread::hardware_concurrency()) == 0) {
+		n_threads = 1;
+	}
+	n_threads = static_cast<unsigned>(std::max<size_t>(std::min<size_t>(n_threads, n / grain), 1));
+	std::atomic<size_t> next(0);
+	std::mutex mutex;
+	std::exception_ptr error;
+	auto work = [&] {
+		for (size_t begin; (begin = next.fetch_add(grain, std::memory_order_relaxed)) < n;) {
+			try {
+				f(begin, begin + std::min(grain, n - begin));
+			}
+			catch (...) {
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!error) {
+					error = std::current_exception();
+				}
+				next.store(n, std::memory_order_relaxed);
+			}
+		}
+	};
+	std::vector<std::thread> threads;
+	threads.reserve(n_threads - 1);
+	for (unsigned i = 1; i < n_threads; ++i) {
+		try {
+			threads.emplace_back(work);
+		}
+		catch (const std::system_error &) {
+			break; // fewer threads then
+		}
+	}
+	work();
+	for (auto &thread : threads) {
+		thread.join();
+	}
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
+
+
+} // namespace satoshi
@@ -1,6 +1,8 @@
 #include "satoshi.h"
 
+#include <algorithm>
 #include <ostream>
+#include <stdexcept>
 
 #include "common/dns.h"
 #include "common/serial.h"
@@ -166,17 +168,53 @@ constexpr char TxMessage::command[12];
 constexpr char BlockMessage::command[12];
 
 Source & operator >> (Source &source, BlockMessage &msg) {
-	return source >> static_cast<BlockHeader &>(msg) >> msg.txns;
+	size_t count;
+	source >> static_cast<BlockHeader &>(msg) >> varint(count);
+	msg.txns = decltype(msg.txns)(); // off any arena it was last read into
+	msg.txns.reserve(std::min(count, Arena::max_reserve));
+	while (count-- > 0) {
+		msg.txns.emplace_back();
+		source >> msg.txns.back();
+	}
+	return source;
+}
+
+Source & operator >> (Source &source, _in_arena<BlockMessage> in) {
+	auto &msg = in.value;
+	if (holds_arena_elements(msg.txns)) {
+		throw std::invalid_argument("block still holds arena-backed transactions");
+	}
+	size_t count;
+	source >> static_cast<BlockHeader &>(msg) >> varint(count);
+	msg.txns = decltype(msg.txns)(&in.arena);
+	msg.txns.reserve(std::min(count, Arena::max_reserve));
+	while (count-- > 0) {
+		msg.txns.emplace_back();
+		source >> in_arena(msg.txns.back(), in.arena);
+	}
+	return source;
 }
 
 Sink & operator << (Sink &sink, const BlockMessage &msg) {
-	return sink << static_cast<const BlockHeader &>(msg) << msg.txns;
+	sink << static_cast<const BlockHeader &>(msg) << varint(msg.txns.size());
+	for (auto &tx : msg.txns) {
+		sink << tx;
+	}
+	return sink;
 }
 
 std::ostream & operator << (std::ostream &os, const BlockMessage &msg) {
 	return os << static_cast<const BlockHeader &>(msg) << " (" << msg.txns.size() << ' ' << (msg.txns.size() == 1 ? "transaction" : "transactions") << ')';
 }
 
+size_t block_weight(const BlockMessage &msg) {
+	size_t n = msg.txns.size(), weight = (80 + (n < 0xFD ? 1 : n <= UINT16_MAX ? 3 : 5)) * 4;
+	for (auto &tx : msg.txns) {
+		weight += tx_weight(tx);
+	}
+	return weight;
+}
+
 
 constexpr char HeadersMessage::command[12];
 
@@ -1,3 +1,5 @@
+#pragma once
+
 #include <iosfwd>
 
 #include <netinet/in.h>
@@ -152,13 +154,17 @@ static inline std::ostream & operator << (std::ostream &os, const TxMessage &msg
 struct BlockMessage : Message, BlockHeader {
 	static constexpr char command[12] = "block";
 
-	std::vector<Tx> txns;
+	std::vector<Tx, ArenaAllocator<Tx>> txns;
 };
 
 Source & operator >> (Source &source, BlockMessage &msg);
+Source & operator >> (Source &source, _in_arena<BlockMessage> msg);
 Sink & operator << (Sink &sink, const BlockMessage &msg);
 std::ostream & operator << (std::ostream &os, const BlockMessage &msg);
 
+// BIP 141 block weight
+size_t block_weight(const BlockMessage &msg) _pure;
+
 
 struct HeadersMessage : Message {
 	static constexpr char command[12] = "headers";
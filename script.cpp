@@ -1,8 +1,11 @@
 #include "script.h"
 
+#include <algorithm>
 #include <iomanip>
 #include <iostream>
+#include <stdexcept>
 
+#include "base16.h"
 #include "common/endian.h"
 #include "common/serial.h"
 
@@ -10,6 +13,8 @@
 namespace satoshi {
 
 
+constexpr size_t Script::inline_capacity;
+
 size_t Script::Iterator::size() const {
 	auto itr = this->itr;
 	if (*itr <= 0x4B) {
@@ -19,15 +24,15 @@ size_t Script::Iterator::size() const {
 		case OP_PUSHDATA1:
 			return *++itr;
 		case OP_PUSHDATA2:
-			return *reinterpret_cast<const be<uint16_t> *>(&*++itr);
+			return *reinterpret_cast<const le<uint16_t> *>(&*++itr);
 		case OP_PUSHDATA4:
-			return *reinterpret_cast<const be<uint32_t> *>(&*++itr);
+			return *reinterpret_cast<const le<uint32_t> *>(&*++itr);
 		default:
 			return 0;
 	}
 }
 
-std::vector<uint8_t>::const_iterator Script::Iterator::begin() const {
+const uint8_t * Script::Iterator::begin() const {
 	auto itr = this->itr;
 	switch (static_cast<Opcode>(*itr)) {
 		case OP_PUSHDATA1:
@@ -92,11 +97,83 @@ intmax_t Script::Iterator::intval() const {
 }
 
 
+Script::Script(Script &&other) noexcept : _size(other._size), _capacity(other._capacity) {
+	if (other.on_heap()) {
+		_heap = other._heap;
+		other._capacity = inline_capacity;
+	}
+	else {
+		std::memcpy(_inline, other._inline, _size);
+	}
+	other._size = 0;
+}
+
+Script & Script::operator = (const Script &other) {
+	if (this != &other) {
+		_size = 0;
+		std::memcpy(this->append(other._size), other.data(), other._size);
+	}
+	return *this;
+}
+
+Script & Script::operator = (Script &&other) noexcept {
+	if (this != &other) {
+		this->free_heap();
+		_size = other._size, _capacity = other._capacity;
+		if (other.on_heap()) {
+			_heap = other._heap;
+			other._capacity = inline_capacity;
+		}
+		else {
+			std::memcpy(_inline, other._inline, _size);
+		}
+		other._size = 0;
+	}
+	return *this;
+}
+
+void Script::reserve(size_t capacity) {
+	if (capacity > _capacity) {
+		if (capacity > UINT32_MAX) {
+			throw std::length_error("script is too large");
+		}
+		// a script that lives in an arena keeps growing in that arena
+		auto arena = this->on_heap() ? _heap.arena : nullptr;
+		auto data = arena ? static_cast<uint8_t *>(arena->allocate(capacity, 1)) : new uint8_t[capacity];
+		std::memcpy(data, this->data(), _size);
+		this->free_heap();
+		_heap.data = data, _heap.arena = arena;
+		_capacity = static_cast<uint32_t>(capacity);
+	}
+}
+
+void Script::resize(size_t size) {
+	if (size > _size) {
+		std::memset(this->append(size - _size), 0, size - _size);
+	}
+	else {
+		_size = static_cast<uint32_t>(size);
+	}
+}
+
+uint8_t * Script::append(size_t n) {
+	if (n > _capacity - _size) {
+		if (n > UINT32_MAX - _size) {
+			throw std::length_error("script is too large");
+		}
+		this->reserve(std::max(static_cast<size_t>(_size) + n, std::min(static_cast<size_t>(_capacity) * 2, static_cast<size_t>(UINT32_MAX))));
+	}
+	auto ret = this->mutable_data() + _size;
+	_size += static_cast<uint32_t>(n);
+	return ret;
+}
+
 bool Script::valid() const {
-	auto end = script.end();
-	for (auto itr = this->begin(); itr != this->end(); ++itr) {
-		auto begin = itr.begin();
-		if (begin > end || itr.size() > static_cast<size_t>(end - begin)) {
+	auto pc = this->data(), end = pc + _size;
+	while (pc < end) {
+		Opcode opcode;
+		Span<const uint8_t> data;
+		if (!read_op(pc, end, opcode, data)) {
 			return false;
 		}
 	}
@@ -134,7 +211,7 @@ void Script::push_int(intmax_t value) {
 				this->push_data(&v, value < INT64_C(0x800000000000) ? value < INT64_C(0x8000000000) ? 5 : 6 : value < INT64_C(0x80000000000000) ? 7 : 8);
 			}
 			if (negate) {
-				script.back() |= 0x80;
+				this->mutable_data()[_size - 1] |= 0x80;
 			}
 		}
 	}
@@ -146,12 +223,12 @@ void Script::push_data(const void *data, size_t size) {
 	}
 	else if (size <= UINT8_MAX) {
 		this->push_opcode(OP_PUSHDATA1);
-		script.push_back(static_cast<uint8_t>(size));
+		*this->append(1) = static_cast<uint8_t>(size);
 	}
 	else if (size <= UINT16_MAX) {
 		this->push_opcode(OP_PUSHDATA2);
-		be<uint16_t> n = static_cast<uint16_t>(size);
-		script.insert(script.end(), reinterpret_cast<uint8_t *>(&n), reinterpret_cast<uint8_t *>(&n + 1));
+		le<uint16_t> n = static_cast<uint16_t>(size);
+		std::memcpy(this->append(sizeof n), &n, sizeof n);
 	}
 #if SIZE_MAX > UINT32_MAX
 	else if (size > UINT32_MAX) {
@@ -160,19 +237,135 @@ void Script::push_data(const void *data, size_t size) {
 #endif
 	else {
 		this->push_opcode(OP_PUSHDATA4);
-		be<uint32_t> n = static_cast<uint32_t>(size);
-		script.insert(script.end(), reinterpret_cast<uint8_t *>(&n), reinterpret_cast<uint8_t *>(&n + 1));
+		le<uint32_t> n = static_cast<uint32_t>(size);
+		std::memcpy(this->append(sizeof n), &n, sizeof n);
+	}
+	std::memcpy(this->append(size), data, size);
+}
+
+void Script::push_copy(Iterator itr) {
+	auto size = static_cast<size_t>(itr.end() - itr.itr);
+	auto begin = this->data();
+	if (itr.itr >= begin && itr.itr < begin + _size) {
+		// copying from within this script, which may be reallocated
+		auto offset = itr.itr - begin;
+		auto out = this->append(size);
+		std::memcpy(out, this->data() + offset, size);
+	}
+	else {
+		std::memcpy(this->append(size), itr.itr, size);
+	}
+}
+
+
+void Script::read(Source &source, size_t size) {
+	_size = 0;
+	while (size > 0) { // grow only as data actually arrives
+		size_t n = std::min(size, size_t(1) << 16);
+		source.read_fully(this->append(n), n);
+		size -= n;
+	}
+}
+
+
+bool read_op(const uint8_t *&pc, const uint8_t *end, Script::Opcode &opcode, Span<const uint8_t> &data) {
+	auto p = pc;
+	if (p >= end) {
+		return false;
+	}
+	opcode = static_cast<Script::Opcode>(*p++);
+	if (opcode > Script::OP_PUSHDATA4) {
+		data = { };
+		pc = p;
+		return true;
+	}
+	size_t size;
+	if (opcode < Script::OP_PUSHDATA1) {
+		size = opcode;
+	}
+	else if (opcode == Script::OP_PUSHDATA1) {
+		if (end - p < 1) {
+			return false;
+		}
+		size = *p++;
+	}
+	else if (opcode == Script::OP_PUSHDATA2) {
+		if (end - p < 2) {
+			return false;
+		}
+		size = *reinterpret_cast<const le<uint16_t> *>(p), p += 2;
+	}
+	else {
+		if (end - p < 4) {
+			return false;
+		}
+		size = *reinterpret_cast<const le<uint32_t> *>(p), p += 4;
+	}
+	if (static_cast<size_t>(end - p) < size) {
+		return false;
+	}
+	data = { p, size };
+	pc = p + size;
+	return true;
+}
+
+
+void DecodedScript::decode(Span<const uint8_t> script) {
+	_script = script;
+	ops.clear();
+	_valid = _push_only = true;
+	auto pc = script.begin(), end = script.end();
+	while (pc < end) {
+		Op op;
+		Span<const uint8_t> data;
+		if (!read_op(pc, end, op.opcode, data)) {
+			_valid = _push_only = false;
+			break;
+		}
+		if (op.opcode > Script::OP_16) {
+			_push_only = false;
+		}
+		op.offset = static_cast<uint32_t>((data.empty() ? pc : data.begin()) - script.begin());
+		op.size = static_cast<uint32_t>(data.size());
+		ops.push_back(op);
 	}
-	script.insert(script.end(), static_cast<const uint8_t *>(data), static_cast<const uint8_t *>(data) + size);
 }
 
 
 Source & operator >> (Source &source, Script &script) {
-	return source >> script.script;
+	size_t size;
+	source >> varint(size);
+	if (script.on_heap() && script._heap.arena) {
+		script = Script(); // off the arena it was last read into
+	}
+	script.read(source, size);
+	return source;
+}
+
+Source & operator >> (Source &source, _in_arena<Script> in) {
+	auto &script = in.value;
+	if (script.on_heap() && script._heap.arena) {
+		throw std::invalid_argument("script still holds an arena-backed buffer");
+	}
+	size_t size;
+	source >> varint(size);
+	if (size <= Script::inline_capacity || size > size_t(1) << 16) {
+		// small enough to be inline, or too large to trust before it arrives
+		script.read(source, size);
+		return source;
+	}
+	script.free_heap();
+	script._heap.data = static_cast<uint8_t *>(in.arena.allocate(size, 1));
+	script._heap.arena = &in.arena;
+	script._size = script._capacity = static_cast<uint32_t>(size);
+	source.read_fully(script._heap.data, size);
+	return source;
 }
 
 Sink & operator << (Sink &sink, const Script &script) {
-	return sink << script.script;
+	sink << varint(script.size());
+	sink.write_fully(script.data(), script.size());
+	return sink;
 }
 
 std::ostream & operator << (std::ostream &os, Script::Opcode opcode) {
@@ -284,41 +477,58 @@ std::ostream & operator << (std::ostream &os, Script::Opcode opcode) {
 	return os;
 }
 
+static void print_op(std::ostream &os, Script::Opcode opcode, Span<const uint8_t> data) {
+	switch (opcode) {
+#define _(v) case Script::OP_##v: os << v; break;
+		_(0) _(1) _(2) _(3) _(4) _(5) _(6) _(7) _(8)
+		_(9) _(10) _(11) _(12) _(13) _(14) _(15) _(16)
+#undef _
+		case Script::OP_1NEGATE:
+			os << -1;
+			break;
+		default:
+			if (data.size() > 0) {
+				os << "0x";
+				char buf[256];
+				for (size_t i = 0; i < data.size(); i += sizeof buf / 2) {
+					size_t n = std::min(data.size() - i, sizeof buf / 2);
+					base16_encode(buf, data.data() + i, n);
+					os.write(buf, n * 2);
+				}
+			}
+			else {
+				os << opcode;
+			}
+	}
+}
+
+// walks the bytes in place, as decoding would allocate
 std::ostream & operator << (std::ostream &os, const Script &script) {
 	if (!script.valid()) {
 		return os << "(invalid)";
 	}
 	auto orig_flags = os.flags(std::ios_base::dec | std::ios_base::right);
-	auto orig_fill = os.fill('0');
 	for (auto itr = script.begin(); itr != script.end(); ++itr) {
 		if (itr != script.begin()) {
 			os << ' ';
 		}
-		auto opcode = itr.opcode();
-		switch (opcode) {
-#define _(v) case Script::OP_##v: os << v; break;
-			_(0) _(1) _(2) _(3) _(4) _(5) _(6) _(7) _(8)
-			_(9) _(10) _(11) _(12) _(13) _(14) _(15) _(16)
-#undef _
-			case Script::OP_1NEGATE:
-				os << -1;
-				break;
-			default: {
-				auto size = itr.size();
-				if (size > 0) {
-					os << std::hex << "0x";
-					for (auto b : itr) {
-						os << std::setw(2) << static_cast<unsigned>(b);
-					}
-					os << std::dec;
-				}
-				else {
-					os << itr.opcode();
-				}
-			}
+		print_op(os, itr.opcode(), Span<const uint8_t>(itr.begin(), itr.size()));
+	}
+	os.flags(orig_flags);
+	return os;
+}
+
+std::ostream & operator << (std::ostream &os, const DecodedScript &script) {
+	if (!script.valid()) {
+		return os << "(invalid)";
+	}
+	auto orig_flags = os.flags(std::ios_base::dec | std::ios_base::right);
+	for (auto &op : script) {
+		if (&op != script.begin()) {
+			os << ' ';
 		}
+		print_op(os, op.opcode, script.data(op));
 	}
-	os.fill(orig_fill);
 	os.flags(orig_flags);
 	return os;
 }
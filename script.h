@@ -1,3 +1,12 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+#include "arena.h"
+#include "span.h"
 #include "common/io.h"
 
 
@@ -6,6 +15,7 @@ namespace satoshi {
 
 class Script {
 	friend Source & operator >> (Source &, Script &);
+	friend Source & operator >> (Source &, _in_arena<Script>);
 	friend Sink & operator << (Sink &, const Script &);
 
 public:
@@ -130,17 +140,17 @@ public:
 	class Iterator {
 		friend Script;
 	private:
-		std::vector<uint8_t>::const_iterator itr;
+		const uint8_t *itr;
 	private:
-		explicit Iterator(std::vector<uint8_t>::const_iterator itr) : itr(itr) { }
+		explicit Iterator(const uint8_t *itr) : itr(itr) { }
 	public:
 		Opcode opcode() const { return static_cast<Opcode>(*itr); }
-		const uint8_t * data() const { return &*this->begin(); }
+		const uint8_t * data() const { return this->begin(); }
 		size_t size() const _pure;
-		std::vector<uint8_t>::const_iterator begin() const _pure;
-		std::vector<uint8_t>::const_iterator end() const { return this->begin() + this->size(); }
-		std::vector<uint8_t>::const_reverse_iterator rbegin() const { return std::vector<uint8_t>::const_reverse_iterator(this->end()); }
-		std::vector<uint8_t>::const_reverse_iterator rend() const { return std::vector<uint8_t>::const_reverse_iterator(this->begin()); }
+		const uint8_t * begin() const _pure;
+		const uint8_t * end() const { return this->begin() + this->size(); }
+		std::reverse_iterator<const uint8_t *> rbegin() const { return std::reverse_iterator<const uint8_t *>(this->end()); }
+		std::reverse_iterator<const uint8_t *> rend() const { return std::reverse_iterator<const uint8_t *>(this->begin()); }
 		intmax_t intval() const _pure;
 	public:
 		Opcode operator * () const { return this->opcode(); }
@@ -149,42 +159,121 @@ public:
 		bool operator != (const Iterator &o) const { return itr != o.itr; }
 	};
 
+public:
+	// large enough to hold every standard output script template inline
+	static constexpr size_t inline_capacity = 40;
+
 private:
-	std::vector<uint8_t> script;
+	uint32_t _size, _capacity;
+	union {
+		struct {
+			uint8_t *data;
+			Arena *arena; // non-null if the buffer belongs to an arena
+		} _heap;
+		uint8_t _inline[inline_capacity];
+	};
 
 public:
-	template <typename... Args>
-	explicit Script(Args&&... args) : script(std::forward<Args>(args)...) { }
+	Script() : _size(), _capacity(inline_capacity) { }
+	Script(const void *data, size_t size) : Script() { std::memcpy(this->append(size), data, size); }
+	template <typename InputIt>
+	Script(InputIt first, InputIt last) : Script() { while (first != last) *this->append(1) = static_cast<uint8_t>(*first++); }
+	explicit Script(const std::vector<uint8_t> &bytes) : Script(bytes.data(), bytes.size()) { }
+	Script(const Script &other) : Script(other.data(), other.size()) { }
+	Script(Script &&other) noexcept;
+	~Script() { this->free_heap(); }
+
+	Script & operator = (const Script &other);
+	Script & operator = (Script &&other) noexcept;
 
 public:
-	const uint8_t * data() const { return script.data(); }
-	size_t size() const { return script.size(); }
-	Iterator begin() const { return Iterator(script.begin()); }
-	Iterator end() const { return Iterator(script.end()); }
+	const uint8_t * data() const { return this->on_heap() ? _heap.data : _inline; }
+	size_t size() const { return _size; }
+	size_t capacity() const { return _capacity; }
+	Iterator begin() const { return Iterator(this->data()); }
+	Iterator end() const { return Iterator(this->data() + _size); }
 
 	bool valid() const _pure;
 
-	void clear() { script.clear(); }
-	void reserve(size_t capacity) { script.reserve(capacity); }
-	void push_opcode(Opcode opcode) { script.push_back(opcode); }
+	void clear() { _size = 0; }
+	void reserve(size_t capacity);
+	void resize(size_t size);
+	void push_opcode(Opcode opcode) { *this->append(1) = opcode; }
 	void push_int(intmax_t value);
 	void push_data(const void *data, size_t size);
-	void push_copy(Iterator itr) { script.insert(script.end(), itr.itr, itr.end()); }
+	void push_copy(Iterator itr);
+
+	bool operator == (const Script &rhs) const { return _size == rhs._size && std::memcmp(this->data(), rhs.data(), _size) == 0; }
+	bool operator != (const Script &rhs) const { return !(*this == rhs); }
+	bool operator < (const Script &rhs) const { return std::lexicographical_compare(this->data(), this->data() + _size, rhs.data(), rhs.data() + rhs._size); }
+	bool operator <= (const Script &rhs) const { return !(rhs < *this); }
+	bool operator > (const Script &rhs) const { return rhs < *this; }
+	bool operator >= (const Script &rhs) const { return !(*this < rhs); }
+
+private:
+	bool on_heap() const { return _capacity > inline_capacity; }
+	uint8_t * mutable_data() { return this->on_heap() ? _heap.data : _inline; }
+	uint8_t * append(size_t n);
+	void read(Source &source, size_t size);
+	void free_heap() { if (this->on_heap() && !_heap.arena) delete[] _heap.data; }
+
+};
+
+// Decodes the instruction at pc and advances past it. Returns false, without
+// advancing, if pc is at the end or a push runs off the end.
+bool read_op(const uint8_t *&pc, const uint8_t *end, Script::Opcode &opcode, Span<const uint8_t> &data);
+
+
+// A script decoded once into a flat table of instructions, for consumers that
+// walk the same script more than once. It views the script's bytes and must
+// not outlive them. Decoding stops at the first push that runs off the end of
+// the script, so an invalid script keeps the instructions that precede it.
+class DecodedScript {
+
+public:
+	struct Op {
+		uint32_t offset; // of the push data, or of the byte after the opcode
+		uint32_t size; // of the push data
+		Script::Opcode opcode;
+	};
+
+private:
+	Span<const uint8_t> _script;
+	std::vector<Op> ops;
+	bool _valid, _push_only;
+
+public:
+	DecodedScript() : _valid(true), _push_only(true) { }
+	explicit DecodedScript(Span<const uint8_t> script) { this->decode(script); }
+	explicit DecodedScript(const Script &script) : DecodedScript(Span<const uint8_t>(script.data(), script.size())) { }
+
+public:
+	// Replaces the decoded script, reusing the instruction table's storage.
+	void decode(Span<const uint8_t> script);
+
+	Span<const uint8_t> script() const { return _script; }
+	bool valid() const { return _valid; }
+	bool push_only() const { return _push_only; }
+
+	size_t size() const { return ops.size(); }
+	bool empty() const { return ops.empty(); }
+	const Op * begin() const { return ops.data(); }
+	const Op * end() const { return ops.data() + ops.size(); }
+	const Op & operator [] (size_t idx) const { return ops[idx]; }
 
-	bool operator == (const Script &rhs) const { return script == rhs.script; }
-	bool operator != (const Script &rhs) const { return script != rhs.script; }
-	bool operator < (const Script &rhs) const { return script < rhs.script; }
-	bool operator <= (const Script &rhs) const { return script <= rhs.script; }
-	bool operator > (const Script &rhs) const { return script > rhs.script; }
-	bool operator >= (const Script &rhs) const { return script >= rhs.script; }
+	Span<const uint8_t> data(const Op &op) const { return _script.subspan(op.offset, op.size); }
+	// the bytes following an instruction
+	Span<const uint8_t> rest(const Op &op) const { return _script.subspan(op.offset + op.size); }
 
 };
 
 Source & operator >> (Source &source, Script &script);
+Source & operator >> (Source &source, _in_arena<Script> script);
 Sink & operator << (Sink &sink, const Script &script);
 
 std::ostream & operator << (std::ostream &os, Script::Opcode opcode);
 std::ostream & operator << (std::ostream &os, const Script &script);
+std::ostream & operator << (std::ostream &os, const DecodedScript &script);
 
 
 } // namespace satoshi
@@ -0,0 +1,546 @@
+#include "secp256k1.h"
+
+#include <algorithm>
+#include <memory>
+
+
+namespace satoshi {
+
+
+typedef unsigned __int128 uint128_t;
+
+// 2^256 = 2^32 + 977 (mod p)
+static constexpr uint64_t fold = UINT64_C(0x1000003D1);
+
+static constexpr FieldElement curve_b = { { 7, 0, 0, 0 } };
+
+static constexpr AffinePoint generator = { {
+	{ UINT64_C(0x59F2815B16F81798), UINT64_C(0x029BFCDB2DCE28D9), UINT64_C(0x55A06295CE870B07), UINT64_C(0x79BE667EF9DCBBAC) }
+}, {
+	{ UINT64_C(0x9C47D08FFB10D4B8), UINT64_C(0xFD17B448A6855419), UINT64_C(0x5DA4FBFC0E1108A8), UINT64_C(0x483ADA7726A3C465) }
+} };
+
+// window widths of the wNAF recodings of the scalars multiplying G and Q
+static constexpr unsigned g_window = 9;
+static constexpr unsigned q_window = 5;
+static constexpr unsigned n_digits = 257;
+
+
+// Reduces a + c*2^256, where a < 2^256 and c < 2^35, to below p.
+static void fe_reduce(FieldElement &r, uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3, uint64_t c) {
+	uint128_t acc = static_cast<uint128_t>(c) * fold + a0;
+	a0 = static_cast<uint64_t>(acc), acc >>= 64;
+	acc += a1, a1 = static_cast<uint64_t>(acc), acc >>= 64;
+	acc += a2, a2 = static_cast<uint64_t>(acc), acc >>= 64;
+	acc += a3, a3 = static_cast<uint64_t>(acc), acc >>= 64;
+	// Having wrapped past 2^256 leaves a value below 2^68, so folding in the
+	// carry cannot wrap again. After that, a value of at least p is one that
+	// wraps past 2^256 once p is subtracted, i.e. once 2^32 + 977 is added.
+	acc = static_cast<uint128_t>(static_cast<uint64_t>(acc) * fold) + a0;
+	a0 = static_cast<uint64_t>(acc), acc >>= 64;
+	acc += a1, a1 = static_cast<uint64_t>(acc), acc >>= 64;
+	acc += a2, a2 = static_cast<uint64_t>(acc), acc >>= 64;
+	acc += a3, a3 = static_cast<uint64_t>(acc);
+	uint128_t sub = static_cast<uint128_t>(a0) + fold;
+	uint64_t s0 = static_cast<uint64_t>(sub);
+	sub = (sub >> 64) + a1;
+	uint64_t s1 = static_cast<uint64_t>(sub);
+	sub = (sub >> 64) + a2;
+	uint64_t s2 = static_cast<uint64_t>(sub);
+	sub = (sub >> 64) + a3;
+	uint64_t s3 = static_cast<uint64_t>(sub);
+	uint64_t mask = -static_cast<uint64_t>(sub >> 64);
+	r.n[0] = s0 & mask | a0 & ~mask;
+	r.n[1] = s1 & mask | a1 & ~mask;
+	r.n[2] = s2 & mask | a2 & ~mask;
+	r.n[3] = s3 & mask | a3 & ~mask;
+}
+
+// reduces the 512-bit product t to below p
+static void fe_reduce_wide(FieldElement &r, const uint64_t t[8]) {
+	uint128_t acc = static_cast<uint128_t>(t[4]) * fold + t[0];
+	uint64_t a0 = static_cast<uint64_t>(acc);
+	acc = (acc >> 64) + static_cast<uint128_t>(t[5]) * fold + t[1];
+	uint64_t a1 = static_cast<uint64_t>(acc);
+	acc = (acc >> 64) + static_cast<uint128_t>(t[6]) * fold + t[2];
+	uint64_t a2 = static_cast<uint64_t>(acc);
+	acc = (acc >> 64) + static_cast<uint128_t>(t[7]) * fold + t[3];
+	uint64_t a3 = static_cast<uint64_t>(acc);
+	fe_reduce(r, a0, a1, a2, a3, static_cast<uint64_t>(acc >> 64));
+}
+
+// three-limb column accumulator for product scanning
+namespace {
+
+struct Accumulator {
+	uint64_t c0, c1, c2;
+
+	void add(uint64_t a, uint64_t b) {
+		uint128_t t = static_cast<uint128_t>(a) * b + c0;
+		c0 = static_cast<uint64_t>(t);
+		t = (t >> 64) + c1;
+		c1 = static_cast<uint64_t>(t);
+		c2 += static_cast<uint64_t>(t >> 64);
+	}
+
+	void add2(uint64_t a, uint64_t b) {
+		this->add(a, b);
+		this->add(a, b);
+	}
+
+	uint64_t shift() {
+		uint64_t ret = c0;
+		c0 = c1, c1 = c2, c2 = 0;
+		return ret;
+	}
+};
+
+} // namespace
+
+void fe_mul(FieldElement &r, const FieldElement &a, const FieldElement &b) {
+	uint64_t t[8];
+	Accumulator acc { 0, 0, 0 };
+	acc.add(a.n[0], b.n[0]);
+	t[0] = acc.shift();
+	acc.add(a.n[0], b.n[1]), acc.add(a.n[1], b.n[0]);
+	t[1] = acc.shift();
+	acc.add(a.n[0], b.n[2]), acc.add(a.n[1], b.n[1]), acc.add(a.n[2], b.n[0]);
+	t[2] = acc.shift();
+	acc.add(a.n[0], b.n[3]), acc.add(a.n[1], b.n[2]), acc.add(a.n[2], b.n[1]), acc.add(a.n[3], b.n[0]);
+	t[3] = acc.shift();
+	acc.add(a.n[1], b.n[3]), acc.add(a.n[2], b.n[2]), acc.add(a.n[3], b.n[1]);
+	t[4] = acc.shift();
+	acc.add(a.n[2], b.n[3]), acc.add(a.n[3], b.n[2]);
+	t[5] = acc.shift();
+	acc.add(a.n[3], b.n[3]);
+	t[6] = acc.shift();
+	t[7] = acc.shift();
+	fe_reduce_wide(r, t);
+}
+
+void fe_sqr(FieldElement &r, const FieldElement &a) {
+	uint64_t t[8];
+	Accumulator acc { 0, 0, 0 };
+	acc.add(a.n[0], a.n[0]);
+	t[0] = acc.shift();
+	acc.add2(a.n[0], a.n[1]);
+	t[1] = acc.shift();
+	acc.add2(a.n[0], a.n[2]), acc.add(a.n[1], a.n[1]);
+	t[2] = acc.shift();
+	acc.add2(a.n[0], a.n[3]), acc.add2(a.n[1], a.n[2]);
+	t[3] = acc.shift();
+	acc.add2(a.n[1], a.n[3]), acc.add(a.n[2], a.n[2]);
+	t[4] = acc.shift();
+	acc.add2(a.n[2], a.n[3]);
+	t[5] = acc.shift();
+	acc.add(a.n[3], a.n[3]);
+	t[6] = acc.shift();
+	t[7] = acc.shift();
+	fe_reduce_wide(r, t);
+}
+
+void fe_add(FieldElement &r, const FieldElement &a, const FieldElement &b) {
+	uint128_t acc = static_cast<uint128_t>(a.n[0]) + b.n[0];
+	uint64_t a0 = static_cast<uint64_t>(acc);
+	acc = (acc >> 64) + a.n[1] + b.n[1];
+	uint64_t a1 = static_cast<uint64_t>(acc);
+	acc = (acc >> 64) + a.n[2] + b.n[2];
+	uint64_t a2 = static_cast<uint64_t>(acc);
+	acc = (acc >> 64) + a.n[3] + b.n[3];
+	fe_reduce(r, a0, a1, a2, static_cast<uint64_t>(acc), static_cast<uint64_t>(acc >> 64));
+}
+
+void fe_sub(FieldElement &r, const FieldElement &a, const FieldElement &b) {
+	// a - b wraps below zero by 2^256, which exceeds p by 2^32 + 977
+	uint128_t acc = static_cast<uint128_t>(a.n[0]) - b.n[0];
+	uint64_t d0 = static_cast<uint64_t>(acc);
+	acc = static_cast<uint128_t>(a.n[1]) - b.n[1] - (acc >> 127);
+	uint64_t d1 = static_cast<uint64_t>(acc);
+	acc = static_cast<uint128_t>(a.n[2]) - b.n[2] - (acc >> 127);
+	uint64_t d2 = static_cast<uint64_t>(acc);
+	acc = static_cast<uint128_t>(a.n[3]) - b.n[3] - (acc >> 127);
+	uint64_t d3 = static_cast<uint64_t>(acc);
+	acc = static_cast<uint128_t>(d0) - (fold & -static_cast<uint64_t>(acc >> 127));
+	r.n[0] = static_cast<uint64_t>(acc);
+	acc = static_cast<uint128_t>(d1) - (acc >> 127);
+	r.n[1] = static_cast<uint64_t>(acc);
+	acc = static_cast<uint128_t>(d2) - (acc >> 127);
+	r.n[2] = static_cast<uint64_t>(acc);
+	r.n[3] = d3 - static_cast<uint64_t>(acc >> 127);
+}
+
+void fe_neg(FieldElement &r, const FieldElement &a) {
+	static constexpr FieldElement zero = { { 0, 0, 0, 0 } };
+	fe_sub(r, zero, a);
+}
+
+static void fe_sqr_n(FieldElement &r, const FieldElement &a, unsigned n) {
+	fe_sqr(r, a);
+	while (--n > 0) {
+		fe_sqr(r, r);
+	}
+}
+
+// Computes a^(2^k - 1) for k = 2, 22 and 223, the runs of ones that the
+// exponents p - 2 and (p + 1)/4 begin with.
+static void fe_pow_prefix(FieldElement &x2, FieldElement &x22, FieldElement &x223, const FieldElement &a) {
+	FieldElement x3, x6, x9, x11, x44, x88, x176, x220;
+	fe_sqr(x2, a);
+	fe_mul(x2, x2, a);
+	fe_sqr(x3, x2);
+	fe_mul(x3, x3, a);
+	fe_sqr_n(x6, x3, 3);
+	fe_mul(x6, x6, x3);
+	fe_sqr_n(x9, x6, 3);
+	fe_mul(x9, x9, x3);
+	fe_sqr_n(x11, x9, 2);
+	fe_mul(x11, x11, x2);
+	fe_sqr_n(x22, x11, 11);
+	fe_mul(x22, x22, x11);
+	fe_sqr_n(x44, x22, 22);
+	fe_mul(x44, x44, x22);
+	fe_sqr_n(x88, x44, 44);
+	fe_mul(x88, x88, x44);
+	fe_sqr_n(x176, x88, 88);
+	fe_mul(x176, x176, x88);
+	fe_sqr_n(x220, x176, 44);
+	fe_mul(x220, x220, x44);
+	fe_sqr_n(x223, x220, 3);
+	fe_mul(x223, x223, x3);
+}
+
+void fe_inv(FieldElement &r, const FieldElement &a) {
+	FieldElement x2, x22, x223, t;
+	fe_pow_prefix(x2, x22, x223, a);
+	fe_sqr_n(t, x223, 23);
+	fe_mul(t, t, x22);
+	fe_sqr_n(t, t, 5);
+	fe_mul(t, t, a);
+	fe_sqr_n(t, t, 3);
+	fe_mul(t, t, x2);
+	fe_sqr_n(t, t, 2);
+	fe_mul(r, t, a);
+}
+
+bool fe_sqrt(FieldElement &r, const FieldElement &a) {
+	FieldElement x2, x22, x223, t;
+	fe_pow_prefix(x2, x22, x223, a);
+	fe_sqr_n(t, x223, 23);
+	fe_mul(t, t, x22);
+	fe_sqr_n(t, t, 6);
+	fe_mul(t, t, x2);
+	fe_sqr_n(t, t, 2);
+	FieldElement check;
+	fe_sqr(check, t);
+	bool ret = fe_equal(check, a);
+	r = t;
+	return ret;
+}
+
+bool fe_set_bytes(FieldElement &r, const uint8_t bytes[32]) {
+	for (size_t i = 0; i < 4; ++i) {
+		uint64_t limb = 0;
+		for (size_t j = 0; j < 8; ++j) {
+			limb = limb << 8 | bytes[(3 - i) * 8 + j];
+		}
+		r.n[i] = limb;
+	}
+	// p is all ones above its low limb
+	return !((r.n[3] & r.n[2] & r.n[1]) == UINT64_MAX && r.n[0] >= UINT64_MAX - fold + 1);
+}
+
+void fe_get_bytes(uint8_t bytes[32], const FieldElement &a) {
+	for (size_t i = 0; i < 4; ++i) {
+		uint64_t limb = a.n[i];
+		for (size_t j = 8; j-- > 0; limb >>= 8) {
+			bytes[(3 - i) * 8 + j] = static_cast<uint8_t>(limb);
+		}
+	}
+}
+
+void fe_set_mpn(FieldElement &r, const mp_limb_t a[MP_NLIMBS(32)]) {
+#if GMP_NUMB_BITS == 64
+	std::copy_n(a, 4, r.n);
+#else
+	for (size_t i = 0; i < 4; ++i) {
+		r.n[i] = static_cast<uint64_t>(a[2 * i + 1]) << 32 | a[2 * i];
+	}
+#endif
+}
+
+void fe_get_mpn(mp_limb_t r[MP_NLIMBS(32)], const FieldElement &a) {
+#if GMP_NUMB_BITS == 64
+	std::copy_n(a.n, 4, r);
+#else
+	for (size_t i = 0; i < 4; ++i) {
+		r[2 * i] = static_cast<mp_limb_t>(a.n[i]), r[2 * i + 1] = static_cast<mp_limb_t>(a.n[i] >> 32);
+	}
+#endif
+}
+
+
+bool point_on_curve(const AffinePoint &a) {
+	FieldElement lhs, rhs;
+	fe_sqr(lhs, a.y);
+	fe_sqr(rhs, a.x);
+	fe_mul(rhs, rhs, a.x);
+	fe_add(rhs, rhs, curve_b);
+	return fe_equal(lhs, rhs);
+}
+
+void point_to_affine(AffinePoint &r, const JacobianPoint &a) {
+	FieldElement z_inv, z_inv2;
+	fe_inv(z_inv, a.Z);
+	fe_sqr(z_inv2, z_inv);
+	fe_mul(r.x, a.X, z_inv2);
+	fe_mul(z_inv2, z_inv2, z_inv);
+	fe_mul(r.y, a.Y, z_inv2);
+}
+
+// the curve has no point of order two, so Y is never zero
+void point_double(JacobianPoint &r, const JacobianPoint &a) {
+	FieldElement A, B, C, D, E, t;
+	fe_sqr(A, a.X);
+	fe_sqr(B, a.Y);
+	fe_sqr(C, B);
+	fe_add(t, a.X, B);
+	fe_sqr(D, t);
+	fe_sub(D, D, A);
+	fe_sub(D, D, C);
+	fe_add(D, D, D); // 4XY^2
+	fe_add(E, A, A);
+	fe_add(E, E, A); // 3X^2
+	fe_mul(t, a.Y, a.Z);
+	fe_add(r.Z, t, t);
+	fe_sqr(t, E);
+	fe_sub(t, t, D);
+	fe_sub(r.X, t, D);
+	fe_sub(t, D, r.X);
+	fe_mul(t, E, t);
+	fe_add(C, C, C);
+	fe_add(C, C, C);
+	fe_add(C, C, C); // 8Y^4
+	fe_sub(r.Y, t, C);
+}
+
+void point_add(JacobianPoint &r, const JacobianPoint &a, const AffinePoint &b) {
+	if (point_is_infinity(a)) {
+		point_set_affine(r, b);
+		return;
+	}
+	FieldElement zz, u, s, h, R;
+	fe_sqr(zz, a.Z);
+	fe_mul(u, b.x, zz);
+	fe_mul(s, b.y, zz);
+	fe_mul(s, s, a.Z);
+	fe_sub(h, u, a.X);
+	fe_sub(R, s, a.Y);
+	if (fe_is_zero(h)) {
+		if (fe_is_zero(R)) {
+			point_double(r, a);
+		}
+		else {
+			point_set_infinity(r);
+		}
+		return;
+	}
+	FieldElement hh, hhh, v, t;
+	fe_sqr(hh, h);
+	fe_mul(hhh, hh, h);
+	fe_mul(v, a.X, hh);
+	fe_mul(s, a.Y, hhh);
+	fe_mul(r.Z, a.Z, h);
+	fe_sqr(t, R);
+	fe_sub(t, t, hhh);
+	fe_sub(t, t, v);
+	fe_sub(r.X, t, v);
+	fe_sub(t, v, r.X);
+	fe_mul(t, R, t);
+	fe_sub(r.Y, t, s);
+}
+
+void point_add(JacobianPoint &r, const JacobianPoint &a, const JacobianPoint &b) {
+	if (point_is_infinity(a)) {
+		r = b;
+		return;
+	}
+	if (point_is_infinity(b)) {
+		r = a;
+		return;
+	}
+	FieldElement z1z1, z2z2, u1, u2, s1, s2, h, R;
+	fe_sqr(z1z1, a.Z);
+	fe_sqr(z2z2, b.Z);
+	fe_mul(u1, a.X, z2z2);
+	fe_mul(u2, b.X, z1z1);
+	fe_mul(s1, a.Y, z2z2);
+	fe_mul(s1, s1, b.Z);
+	fe_mul(s2, b.Y, z1z1);
+	fe_mul(s2, s2, a.Z);
+	fe_sub(h, u2, u1);
+	fe_sub(R, s2, s1);
+	if (fe_is_zero(h)) {
+		if (fe_is_zero(R)) {
+			point_double(r, a);
+		}
+		else {
+			point_set_infinity(r);
+		}
+		return;
+	}
+	FieldElement hh, hhh, t;
+	fe_sqr(hh, h);
+	fe_mul(hhh, hh, h);
+	fe_mul(u1, u1, hh);
+	fe_mul(s1, s1, hhh);
+	fe_mul(t, a.Z, b.Z);
+	fe_mul(r.Z, t, h);
+	fe_sqr(t, R);
+	fe_sub(t, t, hhh);
+	fe_sub(t, t, u1);
+	fe_sub(r.X, t, u1);
+	fe_sub(t, u1, r.X);
+	fe_mul(t, R, t);
+	fe_sub(r.Y, t, s1);
+}
+
+
+void point_to_affine(AffinePoint r[], const JacobianPoint a[], size_t n) {
+	// r[i].x temporarily holds the product of every nonzero Z up to a[i].Z
+	FieldElement product;
+	fe_set_int(product, 1);
+	for (size_t i = 0; i < n; ++i) {
+		if (!point_is_infinity(a[i])) {
+			fe_mul(product, product, a[i].Z);
+		}
+		r[i].x = product;
+	}
+	FieldElement inv, z_inv, z_inv2;
+	fe_inv(inv, product);
+	for (size_t i = n; i-- > 0;) {
+		if (point_is_infinity(a[i])) {
+			fe_set_int(r[i].x, 0), fe_set_int(r[i].y, 0);
+			continue;
+		}
+		if (i > 0) {
+			fe_mul(z_inv, inv, r[i - 1].x);
+			fe_mul(inv, inv, a[i].Z);
+		}
+		else {
+			z_inv = inv;
+		}
+		fe_sqr(z_inv2, z_inv);
+		fe_mul(r[i].x, a[i].X, z_inv2);
+		fe_mul(z_inv2, z_inv2, z_inv);
+		fe_mul(r[i].y, a[i].Y, z_inv2);
+	}
+}
+
+
+namespace {
+
+// j*256^i*G for every byte value j > 0 in every byte position i, so that a
+// multiple of G is the sum of one entry per nonzero byte of the scalar. The
+// first row doubles as the odd multiples of G for wNAF digits.
+struct GeneratorTable {
+	AffinePoint points[32][255];
+	GeneratorTable();
+};
+
+} // namespace
+
+GeneratorTable::GeneratorTable() {
+	std::unique_ptr<JacobianPoint[]> row(new JacobianPoint[256]);
+	AffinePoint base = generator;
+	for (auto &points : this->points) {
+		point_set_affine(row[0], base);
+		for (size_t j = 1; j < 256; ++j) {
+			point_add(row[j], row[j - 1], base);
+		}
+		// the last is 256 times the base of the row, and so the next base
+		point_to_affine(points, row.get(), 255);
+		point_to_affine(base, row[255]);
+	}
+}
+
+// about 510 KiB, built on first use
+static const GeneratorTable & generator_table() {
+	static const GeneratorTable table;
+	return table;
+}
+
+
+static int scalar_bits(const mp_limb_t s[], unsigned bit, unsigned count) {
+	int ret = 0;
+	for (unsigned i = 0; i < count && bit + i < 256; ++i) {
+		ret |= static_cast<int>(s[(bit + i) / GMP_NUMB_BITS] >> (bit + i) % GMP_NUMB_BITS & 1) << i;
+	}
+	return ret;
+}
+
+// Recodes a scalar into digits that are zero or odd and less than 2^(w-1) in
+// magnitude, no two nonzero digits being within w places of each other.
+// Returns the number of digits up to the last nonzero one.
+static unsigned wnaf(int digits[n_digits], const mp_limb_t s[], unsigned w) {
+	std::fill_n(digits, n_digits, 0);
+	unsigned n = 0;
+	int carry = 0;
+	for (unsigned bit = 0; bit < n_digits;) {
+		if (scalar_bits(s, bit, 1) == carry) {
+			++bit;
+			continue;
+		}
+		int word = scalar_bits(s, bit, w) + carry;
+		carry = word >> (w - 1) & 1;
+		word -= carry << w;
+		digits[bit] = word;
+		n = bit + 1;
+		bit += w;
+	}
+	return n;
+}
+
+void point_mul_gen(JacobianPoint &r, const mp_limb_t d[MP_NLIMBS(32)]) {
+	auto &g_table = generator_table();
+	point_set_infinity(r);
+	for (unsigned i = 0; i < 32; ++i) {
+		if (unsigned byte = d[i * 8 / GMP_NUMB_BITS] >> i * 8 % GMP_NUMB_BITS & 0xFF) {
+			point_add(r, r, g_table.points[i][byte - 1]);
+		}
+	}
+}
+
+// Shamir's trick: one chain of doublings shared by both scalars
+void point_mul_gen_add(JacobianPoint &r, const mp_limb_t u1[MP_NLIMBS(32)], const mp_limb_t u2[MP_NLIMBS(32)], const JacobianPoint &Q) {
+	// odd multiples of Q, left in Jacobian coordinates as converting them costs more than it saves
+	JacobianPoint q_table[1 << (q_window - 2)], Q2;
+	q_table[0] = Q;
+	point_double(Q2, Q);
+	for (size_t i = 1; i < sizeof q_table / sizeof *q_table; ++i) {
+		point_add(q_table[i], q_table[i - 1], Q2);
+	}
+	int u1_digits[n_digits], u2_digits[n_digits];
+	unsigned n = std::max(wnaf(u1_digits, u1, g_window), wnaf(u2_digits, u2, q_window));
+	auto &g_table = generator_table();
+	point_set_infinity(r);
+	for (unsigned i = n; i-- > 0;) {
+		point_double(r, r);
+		if (int digit = u1_digits[i]) {
+			AffinePoint P = g_table.points[0][(digit < 0 ? -digit : digit) - 1];
+			if (digit < 0) {
+				fe_neg(P.y, P.y);
+			}
+			point_add(r, r, P);
+		}
+		if (int digit = u2_digits[i]) {
+			JacobianPoint P = q_table[(digit < 0 ? -digit : digit) / 2];
+			if (digit < 0) {
+				fe_neg(P.Y, P.Y);
+			}
+			point_add(r, r, P);
+		}
+	}
+}
+
+
+} // namespace satoshi
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+
+#include "common/compiler.h"
+#include "common/mpn.h"
+
+
+namespace satoshi {
+
+// order of the group generated by G
+static constexpr mp_limb_t secp256k1_n[MP_NLIMBS(32)] = {
+	MP_LIMB_C(0xD0364141, 0xBFD25E8C), MP_LIMB_C(0xAF48A03B, 0xBAAEDCE6),
+	MP_LIMB_C(0xFFFFFFFE, 0xFFFFFFFF), MP_LIMB_C(0xFFFFFFFF, 0xFFFFFFFF)
+};
+
+// Integer modulo p = 2^256 - 2^32 - 977 in four little-endian 64-bit limbs,
+// always fully reduced so that equal elements have equal limbs.
+struct FieldElement {
+	uint64_t n[4];
+};
+
+// Returns false if the big-endian value is not less than p.
+bool fe_set_bytes(FieldElement &r, const uint8_t bytes[32]);
+void fe_get_bytes(uint8_t bytes[32], const FieldElement &a);
+void fe_set_mpn(FieldElement &r, const mp_limb_t a[MP_NLIMBS(32)]);
+void fe_get_mpn(mp_limb_t r[MP_NLIMBS(32)], const FieldElement &a);
+
+static inline void fe_set_int(FieldElement &r, uint64_t a) { r.n[0] = a, r.n[1] = r.n[2] = r.n[3] = 0; }
+static inline bool fe_is_zero(const FieldElement &a) { return (a.n[0] | a.n[1] | a.n[2] | a.n[3]) == 0; }
+static inline bool fe_is_odd(const FieldElement &a) { return a.n[0] & 1; }
+static inline bool fe_equal(const FieldElement &a, const FieldElement &b) {
+	return ((a.n[0] ^ b.n[0]) | (a.n[1] ^ b.n[1]) | (a.n[2] ^ b.n[2]) | (a.n[3] ^ b.n[3])) == 0;
+}
+
+// every result may alias any operand
+void fe_add(FieldElement &r, const FieldElement &a, const FieldElement &b);
+void fe_sub(FieldElement &r, const FieldElement &a, const FieldElement &b);
+void fe_neg(FieldElement &r, const FieldElement &a);
+void fe_mul(FieldElement &r, const FieldElement &a, const FieldElement &b);
+void fe_sqr(FieldElement &r, const FieldElement &a);
+void fe_inv(FieldElement &r, const FieldElement &a);
+// Sets r to a square root of a, and returns false if there is none, in which
+// case r is a square root of -a.
+bool fe_sqrt(FieldElement &r, const FieldElement &a);
+
+
+struct AffinePoint {
+	FieldElement x, y;
+};
+
+// (X/Z^2, Y/Z^3), or the point at infinity if Z is zero
+struct JacobianPoint {
+	FieldElement X, Y, Z;
+};
+
+static inline void point_set_infinity(JacobianPoint &r) { fe_set_int(r.X, 0), fe_set_int(r.Y, 0), fe_set_int(r.Z, 0); }
+static inline bool point_is_infinity(const JacobianPoint &a) { return fe_is_zero(a.Z); }
+static inline void point_set_affine(JacobianPoint &r, const AffinePoint &a) { r.X = a.x, r.Y = a.y, fe_set_int(r.Z, 1); }
+
+bool point_on_curve(const AffinePoint &a) _pure;
+void point_to_affine(AffinePoint &r, const JacobianPoint &a);
+// Converts n points for the price of one inversion and 3(n - 1) extra
+// multiplications, by Montgomery's trick. Points at infinity become (0, 0),
+// as they do singly. r must not alias a.
+void point_to_affine(AffinePoint r[], const JacobianPoint a[], size_t n);
+
+// every result may alias any operand
+void point_double(JacobianPoint &r, const JacobianPoint &a);
+void point_add(JacobianPoint &r, const JacobianPoint &a, const AffinePoint &b);
+void point_add(JacobianPoint &r, const JacobianPoint &a, const JacobianPoint &b);
+
+// r = d*G for a scalar d given as 32 bytes' worth of limbs, in at most 32
+// additions from a table of multiples of G and no doublings
+void point_mul_gen(JacobianPoint &r, const mp_limb_t d[MP_NLIMBS(32)]);
+// r = u1*G + u2*Q
+void point_mul_gen_add(JacobianPoint &r, const mp_limb_t u1[MP_NLIMBS(32)], const mp_limb_t u2[MP_NLIMBS(32)], const JacobianPoint &Q);
+
+
+} // namespace satoshi
@@ -0,0 +1,154 @@
+#include "sigcache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+
+#include "common/serial.h"
+
+
+namespace satoshi {
+
+
+constexpr size_t SignatureCache::default_max_bytes;
+constexpr unsigned SignatureCache::n_ways;
+constexpr unsigned SignatureCache::n_stripes;
+
+// spreads the statistics counters over cache lines by thread
+static unsigned stripe() {
+	static std::atomic<unsigned> next;
+	static thread_local unsigned stripe = next.fetch_add(1, std::memory_order_relaxed);
+	return stripe;
+}
+
+static bool claim(std::atomic<uint32_t> &seq, uint32_t &expected) {
+	return !(expected & 1) && seq.compare_exchange_strong(expected, expected + 1, std::memory_order_acquire, std::memory_order_relaxed);
+}
+
+static void publish(std::atomic<uint32_t> &seq, uint32_t claimed, std::atomic<uint64_t> words[], const uint64_t values[]) {
+	for (size_t i = 0; i < 4; ++i) {
+		words[i].store(values[i], std::memory_order_relaxed);
+	}
+	seq.store(claimed + 2, std::memory_order_release);
+}
+
+SignatureCache::SignatureCache(size_t max_bytes) : n_slots(std::max<size_t>(max_bytes / sizeof(Slot), n_ways)), slots(new Slot[n_slots]()), max_depth(), counters() {
+	std::random_device random;
+	uint32_t salt[8];
+	for (auto &word : salt) {
+		word = random();
+	}
+	salted.write_fully(salt, sizeof salt);
+	for (size_t n = n_slots; n > 1; n >>= 1) {
+		++max_depth;
+	}
+}
+
+bool SignatureCache::contains(const digest256_t &hash, Span<const uint8_t> pubkey, Span<const uint8_t> sig) const {
+	bool found = this->find(this->entry(hash, pubkey, sig));
+	auto &stats = counters[stripe() % n_stripes];
+	(found ? stats.hits : stats.misses).fetch_add(1, std::memory_order_relaxed);
+	return found;
+}
+
+void SignatureCache::insert(const digest256_t &hash, Span<const uint8_t> pubkey, Span<const uint8_t> sig) {
+	auto entry = this->entry(hash, pubkey, sig);
+	if (this->find(entry)) {
+		return;
+	}
+	uint64_t words[4];
+	std::memcpy(words, entry.data(), sizeof words);
+	for (unsigned depth = 0; depth <= max_depth; ++depth) {
+		size_t locations[n_ways];
+		this->locate(locations, entry);
+		for (auto location : locations) {
+			auto &slot = slots[location];
+			uint32_t seq = 0;
+			if (slot.seq.load(std::memory_order_relaxed) == 0 && claim(slot.seq, seq)) {
+				publish(slot.seq, seq, slot.words, words);
+				return;
+			}
+		}
+		// every slot is taken: displace one entry to one of its other slots
+		auto &slot = slots[locations[depth % n_ways]];
+		uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+		if (!claim(slot.seq, seq)) {
+			continue;
+		}
+		uint64_t victim[4];
+		for (size_t i = 0; i < 4; ++i) {
+			victim[i] = slot.words[i].load(std::memory_order_relaxed);
+		}
+		publish(slot.seq, seq, slot.words, words);
+		std::memcpy(words, victim, sizeof words);
+		std::memcpy(entry.data(), victim, sizeof victim);
+	}
+}
+
+uint64_t SignatureCache::hits() const {
+	uint64_t n = 0;
+	for (auto &stats : counters) {
+		n += stats.hits.load(std::memory_order_relaxed);
+	}
+	return n;
+}
+
+uint64_t SignatureCache::misses() const {
+	uint64_t n = 0;
+	for (auto &stats : counters) {
+		n += stats.misses.load(std::memory_order_relaxed);
+	}
+	return n;
+}
+
+void SignatureCache::reset_stats() {
+	for (auto &stats : counters) {
+		stats.hits.store(0, std::memory_order_relaxed);
+		stats.misses.store(0, std::memory_order_relaxed);
+	}
+}
+
+digest256_t SignatureCache::entry(const digest256_t &hash, Span<const uint8_t> pubkey, Span<const uint8_t> sig) const {
+	SHA256 sha(salted);
+	sha.write_fully(hash.data(), hash.size());
+	sha << varint(pubkey.size());
+	sha.write_fully(pubkey.data(), pubkey.size());
+	sha << varint(sig.size());
+	sha.write_fully(sig.data(), sig.size());
+	return sha.digest();
+}
+
+void SignatureCache::locate(size_t locations[], const digest256_t &entry) const {
+	for (unsigned i = 0; i < n_ways; ++i) {
+		uint32_t word;
+		std::memcpy(&word, entry.data() + i * sizeof word, sizeof word);
+		locations[i] = static_cast<size_t>(static_cast<uint64_t>(word) * n_slots >> 32);
+	}
+}
+
+bool SignatureCache::find(const digest256_t &entry) const {
+	size_t locations[n_ways];
+	this->locate(locations, entry);
+	uint64_t words[4];
+	for (auto location : locations) {
+		if (this->read(slots[location], words) && std::memcmp(words, entry.data(), sizeof words) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool SignatureCache::read(const Slot &slot, uint64_t words[]) const {
+	uint32_t seq = slot.seq.load(std::memory_order_acquire);
+	if (seq == 0 || seq & 1) {
+		return false;
+	}
+	for (size_t i = 0; i < 4; ++i) {
+		words[i] = slot.words[i].load(std::memory_order_relaxed);
+	}
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return slot.seq.load(std::memory_order_relaxed) == seq;
+}
+
+
+} // namespace satoshi
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include "span.h"
+#include "types.h"
+#include "common/sha.h"
+
+
+namespace satoshi {
+
+
+// Fixed-size set of signatures already found valid, meant to be shared by
+// every thread that verifies signatures. Entries are salted SHA-256 digests of
+// (message hash, public key, signature), each of which may live in any of
+// eight slots chosen by its own bits. Lookups never block: each slot carries a
+// sequence number that a reader checks before and after reading the entry,
+// and a slot caught mid-write is treated as a miss. Inserting into a full set
+// moves entries to their alternative slots for a while and then overwrites.
+class SignatureCache {
+
+public:
+	static constexpr size_t default_max_bytes = size_t(32) << 20;
+	static constexpr unsigned n_ways = 8;
+
+private:
+	struct Slot {
+		std::atomic<uint32_t> seq; // zero while empty, odd while being written
+		std::atomic<uint64_t> words[4];
+	};
+
+	struct alignas(64) Counters {
+		std::atomic<uint64_t> hits, misses;
+	};
+
+	static constexpr unsigned n_stripes = 16;
+
+private:
+	size_t n_slots;
+	std::unique_ptr<Slot[]> slots;
+	SHA256 salted;
+	unsigned max_depth;
+	mutable Counters counters[n_stripes];
+
+public:
+	explicit SignatureCache(size_t max_bytes = default_max_bytes);
+
+	SignatureCache(const SignatureCache &) = delete;
+	SignatureCache & operator = (const SignatureCache &) = delete;
+
+public:
+	size_t capacity() const { return n_slots; }
+
+	bool contains(const digest256_t &hash, Span<const uint8_t> pubkey, Span<const uint8_t> sig) const;
+	void insert(const digest256_t &hash, Span<const uint8_t> pubkey, Span<const uint8_t> sig);
+
+	uint64_t hits() const;
+	uint64_t misses() const;
+	void reset_stats();
+
+private:
+	digest256_t entry(const digest256_t &hash, Span<const uint8_t> pubkey, Span<const uint8_t> sig) const;
+	void locate(size_t locations[], const digest256_t &entry) const;
+	bool find(const digest256_t &entry) const;
+	bool read(const Slot &slot, uint64_t words[]) const;
+
+};
+
+
+} // namespace satoshi
@@ -0,0 +1,190 @@
+#include "sighash.h"
+
+#include "common/serial.h"
+#include "common/sha.h"
+
+
+namespace satoshi {
+
+
+// Where the reference implementation's decoder leaves off after failing on
+// the truncated instruction at pc, which decides how much of a malformed
+// script code is hashed.
+static const uint8_t * failed_op_end(const uint8_t *pc, const uint8_t *end) {
+	auto opcode = *pc++;
+	size_t n = opcode == Script::OP_PUSHDATA1 ? 1 : opcode == Script::OP_PUSHDATA2 ? 2 : opcode == Script::OP_PUSHDATA4 ? 4 : 0;
+	return static_cast<size_t>(end - pc) < n ? pc : pc + n;
+}
+
+// Writes the script code with every OP_CODESEPARATOR removed.
+static void write_script_code(Sink &sink, Span<const uint8_t> script_code) {
+	auto pc = script_code.begin(), end = script_code.end();
+	size_t n_separators = 0;
+	while (pc < end) {
+		Script::Opcode opcode;
+		Span<const uint8_t> data;
+		if (!read_op(pc, end, opcode, data)) {
+			end = failed_op_end(pc, end);
+			break;
+		}
+		if (opcode == Script::OP_CODESEPARATOR) {
+			++n_separators;
+		}
+	}
+	sink << varint(script_code.size() - n_separators);
+	auto kept = script_code.begin();
+	for (pc = kept; pc < end;) {
+		Script::Opcode opcode;
+		Span<const uint8_t> data;
+		if (!read_op(pc, end, opcode, data)) {
+			pc = end;
+			break;
+		}
+		if (opcode == Script::OP_CODESEPARATOR) {
+			sink.write_fully(kept, pc - 1 - kept);
+			kept = pc;
+		}
+	}
+	sink.write_fully(kept, pc - kept);
+}
+
+digest256_t legacy_sighash(const Tx &tx, size_t input, Span<const uint8_t> script_code, uint32_t hash_type) {
+	static const digest256_t one { 1 };
+	if (input >= tx.inputs.size()) {
+		return one;
+	}
+	auto base_type = hash_type & 0x1F;
+	bool anyone_can_pay = hash_type & SIGHASH_ANYONECANPAY;
+	if (base_type == SIGHASH_SINGLE && input >= tx.outputs.size()) {
+		return one;
+	}
+	SHA256 isha;
+	isha << tx.version;
+	isha << varint(anyone_can_pay ? 1 : tx.inputs.size());
+	for (size_t i = anyone_can_pay ? input : 0; i < (anyone_can_pay ? input + 1 : tx.inputs.size()); ++i) {
+		auto &txin = tx.inputs[i];
+		isha << txin.prevout;
+		if (i == input) {
+			write_script_code(isha, script_code);
+			isha << txin.seq_num;
+		}
+		else {
+			isha << varint(0);
+			isha << (base_type == SIGHASH_NONE || base_type == SIGHASH_SINGLE ? le<uint32_t>(0) : txin.seq_num);
+		}
+	}
+	if (base_type == SIGHASH_NONE) {
+		isha << varint(0);
+	}
+	else if (base_type == SIGHASH_SINGLE) {
+		isha << varint(input + 1);
+		for (size_t i = 0; i < input; ++i) {
+			isha << le<uint64_t>(UINT64_MAX) << varint(0);
+		}
+		isha << tx.outputs[input];
+	}
+	else {
+		isha << varint(tx.outputs.size());
+		for (auto &txout : tx.outputs) {
+			isha << txout;
+		}
+	}
+	isha << tx.lock_time << le<uint32_t>(hash_type);
+	SHA256 osha;
+	osha << isha.digest();
+	return osha.digest();
+}
+
+
+constexpr size_t SighashCache::input_size;
+
+SighashCache::SighashCache(const Tx &tx) {
+	StringSink sink(serialized);
+	sink << tx.version << varint(tx.inputs.size());
+	inputs_offset = serialized.size();
+	midstates.reserve(tx.inputs.size());
+	SHA256 sha;
+	sha.write_fully(serialized.data(), inputs_offset);
+	for (auto &txin : tx.inputs) {
+		midstates.push_back(sha);
+		auto offset = serialized.size();
+		sink << txin.prevout << varint(0) << txin.seq_num;
+		sha.write_fully(serialized.data() + offset, input_size);
+	}
+	sink << varint(tx.outputs.size());
+	output_offsets.reserve(tx.outputs.size() + 1);
+	for (auto &txout : tx.outputs) {
+		output_offsets.push_back(static_cast<uint32_t>(serialized.size()));
+		sink << txout;
+	}
+	output_offsets.push_back(static_cast<uint32_t>(serialized.size()));
+	sink << tx.lock_time;
+}
+
+void SighashCache::write_input(Sink &sink, size_t input, Span<const uint8_t> script_code) const {
+	auto p = this->input_data(input);
+	sink.write_fully(p, sizeof(OutPoint));
+	write_script_code(sink, script_code);
+	sink.write_fully(p + sizeof(OutPoint) + 1, sizeof(uint32_t));
+}
+
+digest256_t SighashCache::sighash(size_t input, Span<const uint8_t> script_code, uint32_t hash_type) const {
+	static const digest256_t one { 1 };
+	size_t n_inputs = this->n_inputs(), n_outputs = this->n_outputs();
+	auto base_type = hash_type & 0x1F;
+	bool anyone_can_pay = hash_type & SIGHASH_ANYONECANPAY;
+	if (input >= n_inputs || base_type == SIGHASH_SINGLE && input >= n_outputs) {
+		return one;
+	}
+	auto data = serialized.data();
+	size_t outputs_offset = inputs_offset + n_inputs * input_size; // at the output count
+	size_t lock_time_offset = output_offsets.back();
+	SHA256 isha;
+	if (anyone_can_pay) {
+		isha.write_fully(data, sizeof(uint32_t));
+		isha << varint(1);
+		this->write_input(isha, input, script_code);
+	}
+	else if (base_type != SIGHASH_NONE && base_type != SIGHASH_SINGLE) {
+		isha = midstates[input];
+		this->write_input(isha, input, script_code);
+		auto next = this->input_data(input + 1);
+		isha.write_fully(next, data + lock_time_offset - next);
+	}
+	else {
+		// other inputs are hashed with zero sequence numbers
+		static const uint8_t zeros[5] = { };
+		isha.write_fully(data, inputs_offset);
+		for (size_t i = 0; i < n_inputs; ++i) {
+			if (i == input) {
+				this->write_input(isha, input, script_code);
+			}
+			else {
+				isha.write_fully(this->input_data(i), sizeof(OutPoint));
+				isha.write_fully(zeros, sizeof zeros);
+			}
+		}
+	}
+	if (base_type == SIGHASH_NONE) {
+		isha << varint(0);
+	}
+	else if (base_type == SIGHASH_SINGLE) {
+		static const uint8_t null_output[9] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00 };
+		isha << varint(input + 1);
+		for (size_t i = 0; i < input; ++i) {
+			isha.write_fully(null_output, sizeof null_output);
+		}
+		isha.write_fully(data + output_offsets[input], output_offsets[input + 1] - output_offsets[input]);
+	}
+	else if (anyone_can_pay) {
+		isha.write_fully(data + outputs_offset, lock_time_offset - outputs_offset);
+	}
+	isha.write_fully(data + lock_time_offset, sizeof(uint32_t));
+	isha << le<uint32_t>(hash_type);
+	SHA256 osha;
+	osha << isha.digest();
+	return osha.digest();
+}
+
+
+} // namespace satoshi
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "blockchain.h"
+#include "span.h"
+#include "common/sha.h"
+
+
+namespace satoshi {
+
+
+enum SighashType : uint8_t {
+	SIGHASH_ALL = 0x01,
+	SIGHASH_NONE = 0x02,
+	SIGHASH_SINGLE = 0x03,
+	SIGHASH_ANYONECANPAY = 0x80,
+};
+
+// Pre-segwit signature hash of input `input` of `tx`, with script_code taken
+// from the last executed OP_CODESEPARATOR. Reproduces the consensus quirks:
+// SIGHASH_SINGLE without a matching output hashes to one.
+digest256_t legacy_sighash(const Tx &tx, size_t input, Span<const uint8_t> script_code, uint32_t hash_type);
+
+
+// Legacy signature hashes of every input of one transaction, sharing the work
+// that does not depend on the input. The transaction is serialized once with
+// empty input scripts, and the SHA-256 state after each input's prefix is
+// kept, so a SIGHASH_ALL hash resumes from that state and hashes the rest of
+// the serialization straight from the buffer. The suffix that follows the
+// signed input still has to be hashed each time. A cache is immutable once
+// built and may be shared between threads.
+class SighashCache {
+
+private:
+	std::string serialized; // input scripts empty
+	size_t inputs_offset; // of the first input
+	std::vector<uint32_t> output_offsets; // of each output, then of the lock time
+	std::vector<SHA256> midstates; // after all inputs before each one
+
+public:
+	explicit SighashCache(const Tx &tx);
+
+public:
+	size_t n_inputs() const { return midstates.size(); }
+	size_t n_outputs() const { return output_offsets.size() - 1; }
+
+	// same as legacy_sighash() for the transaction the cache was built from
+	digest256_t sighash(size_t input, Span<const uint8_t> script_code, uint32_t hash_type) const;
+
+private:
+	static constexpr size_t input_size = sizeof(OutPoint) + 1 + sizeof(uint32_t);
+
+	const char * input_data(size_t input) const { return serialized.data() + inputs_offset + input * input_size; }
+	void write_input(Sink &sink, size_t input, Span<const uint8_t> script_code) const;
+
+};
+
+
+} // namespace satoshi
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+
+
+namespace satoshi {
+
+
+// Non-owning view of a contiguous sequence.
+template <typename T>
+class Span {
+
+private:
+	T *_data;
+	size_t _size;
+
+public:
+	constexpr Span() : _data(), _size() { }
+	constexpr Span(T *data, size_t size) : _data(data), _size(size) { }
+	template <size_t N>
+	constexpr Span(T (&array)[N]) : _data(array), _size(N) { }
+	template <typename C, typename = typename std::enable_if<std::is_convertible<decltype(std::declval<C &>().data()), T *>::value>::type>
+	constexpr Span(C &container) : _data(container.data()), _size(container.size()) { }
+	template <typename U, typename = typename std::enable_if<std::is_convertible<U *, T *>::value>::type>
+	constexpr Span(const Span<U> &other) : _data(other.data()), _size(other.size()) { }
+
+public:
+	constexpr T * data() const { return _data; }
+	constexpr size_t size() const { return _size; }
+	constexpr bool empty() const { return _size == 0; }
+	constexpr T * begin() const { return _data; }
+	constexpr T * end() const { return _data + _size; }
+	constexpr T & operator [] (size_t idx) const { return _data[idx]; }
+	constexpr T & front() const { return _data[0]; }
+	constexpr T & back() const { return _data[_size - 1]; }
+	constexpr Span subspan(size_t offset) const { return { _data + offset, _size - offset }; }
+	constexpr Span subspan(size_t offset, size_t count) const { return { _data + offset, count }; }
+
+};
+
+
+} // namespace satoshi
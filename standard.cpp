@@ -0,0 +1,274 @@
+#include "standard.h"
+
+#include <cstring>
+#include <ostream>
+
+
+namespace satoshi {
+
+
+std::ostream & operator << (std::ostream &os, ScriptType type) {
+	if (auto name = script_type_name(type)) {
+		return os << name;
+	}
+	return os << static_cast<unsigned>(type);
+}
+
+const char * script_type_name(ScriptType type) {
+	switch (type) {
+#define _(t) case ScriptType::t: return #t;
+		_(NONSTANDARD)
+		_(PUBKEY)
+		_(PUBKEYHASH)
+		_(SCRIPTHASH)
+		_(MULTISIG)
+		_(NULL_DATA)
+		_(WITNESS_V0_KEYHASH)
+		_(WITNESS_V0_SCRIPTHASH)
+		_(WITNESS_V1_TAPROOT)
+		_(WITNESS_UNKNOWN)
+#undef _
+	}
+	return nullptr;
+}
+
+
+// Fixed-length templates are matched by size and their constant bytes alone.
+// The variable parts are described with the template pseudo-opcodes and are
+// matched an instruction at a time.
+
+static constexpr uint8_t multisig_template[] = { Script::OP_SMALLINTEGER, Script::OP_PUBKEYS, Script::OP_SMALLINTEGER, Script::OP_CHECKMULTISIG };
+static constexpr uint8_t null_data_template[] = { Script::OP_RETURN, Script::OP_SMALLDATA };
+
+static inline bool _const is_valid_pubkey_size(uint8_t prefix, size_t size) {
+	switch (prefix) {
+		case 0x02: case 0x03:
+			return size == 33;
+		case 0x04: case 0x06: case 0x07:
+			return size == 65;
+	}
+	return false;
+}
+
+static inline ScriptMatch make_match(ScriptType type, Span<const uint8_t> data, uint8_t version = 0) {
+	ScriptMatch match;
+	match.type = type, match.version = version, match.required = match.keys = 0, match.data = data;
+	return match;
+}
+
+// walks a script's instructions straight from its bytes
+class RawCursor {
+	const uint8_t *pc, *end;
+public:
+	explicit RawCursor(Span<const uint8_t> script) : pc(script.begin()), end(script.end()) { }
+	const uint8_t * pos() const { return pc; }
+	bool at_end() const { return pc == end; }
+	bool next(Script::Opcode &opcode, Span<const uint8_t> &data) { return read_op(pc, end, opcode, data); }
+};
+
+// walks the instruction table of a decoded script
+class DecodedCursor {
+	const DecodedScript *script;
+	const DecodedScript::Op *op;
+	const uint8_t *pc;
+public:
+	explicit DecodedCursor(const DecodedScript &script) : script(&script), op(script.begin()), pc(script.script().begin()) { }
+	const uint8_t * pos() const { return pc; }
+	bool at_end() const { return pc == script->script().end(); }
+	bool next(Script::Opcode &opcode, Span<const uint8_t> &data) {
+		if (op == script->end()) {
+			return false;
+		}
+		opcode = op->opcode, data = script->data(*op), pc = script->rest(*op).begin(), ++op;
+		return true;
+	}
+};
+
+template <typename Cursor>
+static bool match_template(ScriptMatch &match, Cursor cursor, Span<const uint8_t> tmpl) {
+	uint8_t ints[2];
+	size_t n_ints = 0, n_keys = 0;
+	const uint8_t *data_begin = nullptr, *data_end = nullptr;
+	Script::Opcode opcode;
+	Span<const uint8_t> data;
+	for (auto t : tmpl) {
+		switch (t) {
+			case Script::OP_SMALLINTEGER:
+				if (!cursor.next(opcode, data) || opcode < Script::OP_1 || opcode > Script::OP_16 || n_ints == sizeof ints) {
+					return false;
+				}
+				ints[n_ints++] = static_cast<uint8_t>(opcode - (Script::OP_1 - 1));
+				break;
+			case Script::OP_PUBKEYS:
+				data_begin = cursor.pos();
+				for (;;) {
+					auto peek = cursor;
+					if (!peek.next(opcode, data) || opcode > Script::OP_PUSHDATA4 || data.empty() || !is_valid_pubkey_size(data[0], data.size())) {
+						break;
+					}
+					cursor = peek, ++n_keys;
+				}
+				if (n_keys == 0) {
+					return false;
+				}
+				data_end = cursor.pos();
+				break;
+			case Script::OP_SMALLDATA:
+				data_begin = cursor.pos();
+				while (!cursor.at_end()) {
+					if (!cursor.next(opcode, data) || opcode > Script::OP_16) {
+						return false;
+					}
+				}
+				data_end = cursor.pos();
+				break;
+			default:
+				if (!cursor.next(opcode, data) || opcode != t) {
+					return false;
+				}
+				break;
+		}
+	}
+	if (!cursor.at_end()) {
+		return false;
+	}
+	match.data = { data_begin, static_cast<size_t>(data_end - data_begin) };
+	if (n_ints == 2) {
+		match.required = ints[0], match.keys = ints[1];
+		if (match.keys != n_keys || match.required > match.keys) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Matches the templates that are identified by their bytes alone.
+static bool match_fixed(ScriptMatch &match, Span<const uint8_t> script) {
+	auto p = script.data();
+	switch (script.size()) {
+		case 22:
+			if (p[0] == Script::OP_0 && p[1] == 20) {
+				return match = make_match(ScriptType::WITNESS_V0_KEYHASH, script.subspan(2), 0), true;
+			}
+			break;
+		case 23:
+			if (p[0] == Script::OP_HASH160 && p[1] == 20 && p[22] == Script::OP_EQUAL) {
+				return match = make_match(ScriptType::SCRIPTHASH, script.subspan(2, 20)), true;
+			}
+			break;
+		case 25:
+			if (p[0] == Script::OP_DUP && p[1] == Script::OP_HASH160 && p[2] == 20 && p[23] == Script::OP_EQUALVERIFY && p[24] == Script::OP_CHECKSIG) {
+				return match = make_match(ScriptType::PUBKEYHASH, script.subspan(3, 20)), true;
+			}
+			break;
+		case 34:
+			if (p[0] == Script::OP_0 && p[1] == 32) {
+				return match = make_match(ScriptType::WITNESS_V0_SCRIPTHASH, script.subspan(2), 0), true;
+			}
+			if (p[0] == Script::OP_1 && p[1] == 32) {
+				return match = make_match(ScriptType::WITNESS_V1_TAPROOT, script.subspan(2), 1), true;
+			}
+			break;
+		case 35:
+			if (p[0] == 33 && p[34] == Script::OP_CHECKSIG && is_valid_pubkey_size(p[1], 33)) {
+				return match = make_match(ScriptType::PUBKEY, script.subspan(1, 33)), true;
+			}
+			break;
+		case 67:
+			if (p[0] == 65 && p[66] == Script::OP_CHECKSIG && is_valid_pubkey_size(p[1], 65)) {
+				return match = make_match(ScriptType::PUBKEY, script.subspan(1, 65)), true;
+			}
+			break;
+	}
+	if (script.empty()) {
+		return match = make_match(ScriptType::NONSTANDARD, { }), true;
+	}
+	// BIP 141 witness program of a version not handled above
+	if (script.size() >= 4 && script.size() <= 42 && (p[0] == Script::OP_0 || p[0] >= Script::OP_1 && p[0] <= Script::OP_16) && p[1] + size_t(2) == script.size()) {
+		if (p[0] == Script::OP_0) {
+			return match = make_match(ScriptType::NONSTANDARD, { }), true;
+		}
+		return match = make_match(ScriptType::WITNESS_UNKNOWN, script.subspan(2), static_cast<uint8_t>(p[0] - (Script::OP_1 - 1))), true;
+	}
+	return false;
+}
+
+template <typename Cursor>
+static ScriptMatch classify(Span<const uint8_t> script, Cursor cursor) {
+	ScriptMatch match;
+	if (match_fixed(match, script)) {
+		return match;
+	}
+	match = make_match(ScriptType::NONSTANDARD, { });
+	if (script[0] == Script::OP_RETURN) {
+		if (match_template(match, cursor, null_data_template)) {
+			match.type = ScriptType::NULL_DATA;
+			return match;
+		}
+	}
+	else if (script.back() == Script::OP_CHECKMULTISIG) {
+		if (match_template(match, cursor, multisig_template) && match.required > 0) {
+			match.type = ScriptType::MULTISIG;
+			return match;
+		}
+	}
+	return make_match(ScriptType::NONSTANDARD, { });
+}
+
+ScriptMatch classify_script(Span<const uint8_t> script) {
+	return classify(script, RawCursor(script));
+}
+
+ScriptMatch classify_script(const DecodedScript &script) {
+	return classify(script.script(), DecodedCursor(script));
+}
+
+Span<const uint8_t> multisig_key(const ScriptMatch &match, size_t idx) {
+	const uint8_t *pc = match.data.begin(), *end = match.data.end();
+	Script::Opcode opcode;
+	Span<const uint8_t> data;
+	do {
+		if (!read_op(pc, end, opcode, data)) {
+			return { };
+		}
+	} while (idx-- > 0);
+	return data;
+}
+
+bool match_to_address(Address &address, const ScriptMatch &match, bool testnet) {
+	switch (match.type) {
+		case ScriptType::PUBKEYHASH:
+			address.type = testnet ? Address::Type::TESTNET_PUBKEY_HASH : Address::Type::PUBKEY_HASH;
+			break;
+		case ScriptType::SCRIPTHASH:
+			address.type = testnet ? Address::Type::TESTNET_SCRIPT_HASH : Address::Type::SCRIPT_HASH;
+			break;
+		default:
+			return false;
+	}
+	std::memcpy(address.hash.data(), match.data.data(), address.hash.size());
+	return true;
+}
+
+size_t count_outputs(const BlockMessage &block) {
+	size_t n = 0;
+	for (auto &tx : block.txns) {
+		n += tx.outputs.size();
+	}
+	return n;
+}
+
+void classify_outputs(ScriptMatch out[], const BlockMessage &block) {
+	for (auto &tx : block.txns) {
+		auto txout = tx.outputs.data(), txout_end = txout + tx.outputs.size();
+		for (; txout < txout_end; ++txout) {
+			if (txout + 1 < txout_end) {
+				__builtin_prefetch(txout[1].script.data());
+			}
+			*out++ = classify_script(txout->script);
+		}
+	}
+}
+
+
+} // namespace satoshi
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <iosfwd>
+
+#include "satoshi.h"
+#include "script.h"
+#include "span.h"
+#include "types.h"
+
+
+namespace satoshi {
+
+
+enum class ScriptType : uint8_t {
+	NONSTANDARD,
+	PUBKEY,
+	PUBKEYHASH,
+	SCRIPTHASH,
+	MULTISIG,
+	NULL_DATA,
+	WITNESS_V0_KEYHASH,
+	WITNESS_V0_SCRIPTHASH,
+	WITNESS_V1_TAPROOT,
+	WITNESS_UNKNOWN,
+};
+
+std::ostream & operator << (std::ostream &os, ScriptType type);
+// the enumerator's name, or null if type is not one
+const char * script_type_name(ScriptType type) _const;
+
+
+// Result of matching a scriptPubKey against the standard templates. The data
+// view points into the classified script and is valid only as long as it is.
+struct ScriptMatch {
+	ScriptType type;
+	uint8_t version; // witness version
+	uint8_t required, keys; // multisig m-of-n
+	// PUBKEY: the public key; PUBKEYHASH, SCRIPTHASH: the 20-byte hash;
+	// MULTISIG: the key pushes, see multisig_key(); NULL_DATA: everything after
+	// OP_RETURN; WITNESS_*: the witness program
+	Span<const uint8_t> data;
+};
+
+ScriptMatch classify_script(Span<const uint8_t> script) _pure;
+
+static inline ScriptMatch classify_script(const Script &script) {
+	return classify_script(Span<const uint8_t>(script.data(), script.size()));
+}
+
+ScriptMatch classify_script(const DecodedScript &script) _pure;
+
+// Returns the idx'th public key of a MULTISIG match.
+Span<const uint8_t> multisig_key(const ScriptMatch &match, size_t idx) _pure;
+
+// Fills in the address of a PUBKEYHASH or SCRIPTHASH match.
+bool match_to_address(Address &address, const ScriptMatch &match, bool testnet = false);
+
+size_t count_outputs(const BlockMessage &block) _pure;
+
+// Classifies every output of every transaction in block order. The out array
+// must have room for count_outputs(block) entries.
+void classify_outputs(ScriptMatch out[], const BlockMessage &block);
+
+
+} // namespace satoshi
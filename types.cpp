@@ -1,14 +1,15 @@
 #include "types.h"
 
+#include <algorithm>
 #include <ctime>
-#include <iomanip>
+#include <memory>
 
+#include "base16.h"
 #include "base58check.h"
-#include "common/codec.h"
-#include "common/ecp.h"
+#include "hash160.h"
+#include "parallel.h"
+#include "secp256k1.h"
 #include "common/endian.h"
-#include "common/fp.h"
-#include "common/hex.h"
 #include "common/narrow.h"
 #include "common/ripemd.h"
 #include "common/serial.h"
@@ -18,26 +19,78 @@
 namespace satoshi {
 
 
+std::ostream & operator << (std::ostream &os, DecodeError error) {
+	switch (error) {
+#define _(e) case DecodeError::e: return os << #e;
+		_(OK)
+		_(INVALID_ENCODING)
+		_(INVALID_CHECKSUM)
+		_(INVALID_LENGTH)
+		_(INVALID_TYPE)
+#undef _
+	}
+	return os << static_cast<unsigned>(error);
+}
+
+static DecodeError base58check_decode_error(Base58CheckError error) {
+	switch (error) {
+		case Base58CheckError::OK:
+			return DecodeError::OK;
+		case Base58CheckError::BUFFER_TOO_SMALL:
+			return DecodeError::INVALID_LENGTH;
+		case Base58CheckError::BAD_CHECKSUM:
+			return DecodeError::INVALID_CHECKSUM;
+		default:
+			return DecodeError::INVALID_ENCODING;
+	}
+}
+
+// Bounds the Base58Check encoding of n bytes from above, since each base-58
+// digit carries more than 100/138 of a byte, so that overlong input can be
+// turned away before any arithmetic.
+static constexpr size_t base58check_max_length(size_t n) {
+	return (n + 4) * 138 / 100 + 1;
+}
+
+static void throw_decode_error(DecodeError error, const char what[]) {
+	if (error == DecodeError::INVALID_ENCODING || error == DecodeError::INVALID_CHECKSUM) {
+		throw std::ios_base::failure("invalid Base58Check");
+	}
+	throw std::ios_base::failure(what);
+}
+
+
+DecodeError try_decode_privkey(PrivateKey &privkey, const char str[], size_t n) noexcept {
+	uint8_t bytes[34];
+	size_t n_bytes = sizeof bytes;
+	if (n > base58check_max_length(sizeof bytes)) {
+		return DecodeError::INVALID_LENGTH;
+	}
+	auto error = base58check_decode_error(base58check_try_decode(bytes, n_bytes, str, n));
+	if (error != DecodeError::OK) {
+		return error;
+	}
+	if (n_bytes != sizeof bytes && n_bytes != sizeof bytes - 1) {
+		return DecodeError::INVALID_LENGTH;
+	}
+	if (bytes[0] != 0x80) {
+		return DecodeError::INVALID_TYPE;
+	}
+	privkey.flags = n_bytes == sizeof bytes ? static_cast<PrivateKey::Flags>(bytes[33]) : PrivateKey::Flags::NONE;
+	if ((privkey.flags & ~PrivateKey::Flags::MASK) != PrivateKey::Flags::NONE) {
+		return DecodeError::INVALID_TYPE;
+	}
+	bytes_to_mpn(privkey.d, bytes + 1, 32);
+	return DecodeError::OK;
+}
+
 PrivateKey decode_privkey(const char privkey[], size_t n) {
 	PrivateKey ret;
-	uint8_t bytes[34];
-	n = base58check_decode(bytes, sizeof bytes, privkey, n);
-	if (bytes[0] == 0x80) {
-		if (n == sizeof bytes) {
-			ret.flags = static_cast<PrivateKey::Flags>(bytes[33]);
-			if ((ret.flags & ~PrivateKey::Flags::MASK) != PrivateKey::Flags::NONE) {
-				throw std::ios_base::failure("unrecognized flags in private key");
-			}
-			bytes_to_mpn(ret.d, bytes + 1, 32);
-			return ret;
-		}
-		if (n == sizeof bytes - 1) {
-			ret.flags = PrivateKey::Flags::NONE;
-			bytes_to_mpn(ret.d, bytes + 1, 32);
-			return ret;
-		}
+	auto error = try_decode_privkey(ret, privkey, n);
+	if (error != DecodeError::OK) {
+		throw_decode_error(error, "expected private key");
 	}
-	throw std::ios_base::failure("expected private key");
+	return ret;
 }
 
 std::string encode_privkey(const PrivateKey &privkey) {
@@ -104,21 +157,55 @@ Sink & operator << (Sink &sink, const PublicKey &pubkey) {
 	return sink;
 }
 
+DecodeError try_decode_pubkey(PublicKey &pubkey, const char str[], size_t n) noexcept {
+	if (n != 33 * 2 && n != 65 * 2) {
+		return DecodeError::INVALID_LENGTH;
+	}
+	uint8_t bytes[65];
+	if (!base16_decode(bytes, str, n / 2)) {
+		return DecodeError::INVALID_ENCODING;
+	}
+	if (n == 33 * 2) {
+		if ((bytes[0] | 1) != 0x03) {
+			return DecodeError::INVALID_TYPE;
+		}
+		CompressedPublicKey serialized;
+		std::memcpy(serialized.bytes.data(), bytes, 33);
+		pubkey = deserialize_pubkey(serialized);
+	}
+	else {
+		if (bytes[0] != 0x04) {
+			return DecodeError::INVALID_TYPE;
+		}
+		UncompressedPublicKey serialized;
+		std::memcpy(serialized.bytes.data(), bytes, 65);
+		pubkey = deserialize_pubkey(serialized);
+	}
+	return DecodeError::OK;
+}
+
 PublicKey decode_pubkey(const char pubkey[], size_t n) {
 	PublicKey ret;
-	MemorySource ms(pubkey, n);
-	CodecSource<HexDecoder> cs(ms);
-	cs >> ret;
+	auto error = try_decode_pubkey(ret, pubkey, n);
+	if (error == DecodeError::INVALID_ENCODING) {
+		throw std::ios_base::failure("invalid hex");
+	}
+	if (error != DecodeError::OK) {
+		throw std::ios_base::failure("expected public key");
+	}
 	return ret;
 }
 
 std::string encode_pubkey(const PublicKey &pubkey) {
-	std::string ret;
-	ret.reserve(pubkey.compress ? 66 : 130);
-	StringSink ss(ret);
-	CodecSink<HexEncoder> cs(ss);
-	cs << pubkey;
-	return ret;
+	char buf[130];
+	if (pubkey.compress) {
+		auto serialized = serialize_pubkey<33>(pubkey);
+		base16_encode(buf, serialized.bytes.data(), serialized.bytes.size());
+		return { buf, 66 };
+	}
+	auto serialized = serialize_pubkey<65>(pubkey);
+	base16_encode(buf, serialized.bytes.data(), serialized.bytes.size());
+	return { buf, 130 };
 }
 
 std::istream & operator >> (std::istream &is, PublicKey &pubkey) {
@@ -133,40 +220,131 @@ std::ostream & operator << (std::ostream &os, const PublicKey &pubkey) {
 }
 
 void decompress_pubkey(PublicKey &pubkey) {
-	static constexpr mp_limb_t magic[] = {
-		MP_LIMB_C(0xBFFFFF0C, 0xFFFFFFFF), MP_LIMB_C(0xFFFFFFFF, 0xFFFFFFFF),
-		MP_LIMB_C(0xFFFFFFFF, 0xFFFFFFFF), MP_LIMB_C(0xFFFFFFFF, 0x3FFFFFFF)
-	};
 	if (mpn_zero_p(pubkey.Q[2], MP_NLIMBS(32))) {
-		bool even = mpn_even_p(pubkey.Q[1], MP_NLIMBS(32));
-		mp_limb_t y2[MP_NLIMBS(32)];
-		fp_mul(pubkey.Q[2], pubkey.Q[0], pubkey.Q[0], secp256k1_p);
-		fp_mul(y2, pubkey.Q[2], pubkey.Q[0], secp256k1_p);
-		if (mpn_add_1(y2, y2, MP_NLIMBS(32), 7 /* secp256k1_b */) || mpn_cmp(y2, secp256k1_p, MP_NLIMBS(32)) >= 0) {
-			mpn_sub_n(y2, y2, secp256k1_p, MP_NLIMBS(32));
-		}
-		fp_pow(pubkey.Q[1], y2, magic, secp256k1_p);
-		if (mpn_even_p(pubkey.Q[1], MP_NLIMBS(32)) != even) {
-			mpn_sub_n(pubkey.Q[1], secp256k1_p, pubkey.Q[1], MP_NLIMBS(32));
+		FieldElement x, y, y2;
+		fe_set_mpn(x, pubkey.Q[0]);
+		fe_sqr(y2, x);
+		fe_mul(y2, y2, x);
+		fe_set_int(y, 7 /* secp256k1_b */);
+		fe_add(y2, y2, y);
+		fe_sqrt(y, y2);
+		if (fe_is_odd(y) != !mpn_even_p(pubkey.Q[1], MP_NLIMBS(32))) {
+			fe_neg(y, y);
 		}
+		fe_get_mpn(pubkey.Q[1], y);
 		mpn_zero(pubkey.Q[2], MP_NLIMBS(32)), pubkey.Q[2][0] = 1;
 	}
 }
 
 
+template <size_t N>
+Source & operator >> (Source &source, SerializedPublicKey<N> &pubkey) {
+	source.read_fully(pubkey.bytes.data(), N);
+	if (N == 33 ? (pubkey.bytes[0] | 1) != 0x03 : pubkey.bytes[0] != 0x04) {
+		throw std::ios_base::failure("expected public key");
+	}
+	return source;
+}
+
+template <size_t N>
+Sink & operator << (Sink &sink, const SerializedPublicKey<N> &pubkey) {
+	sink.write_fully(pubkey.bytes.data(), N);
+	return sink;
+}
+
+template <size_t N>
+SerializedPublicKey<N> serialize_pubkey(const PublicKey &pubkey) {
+	SerializedPublicKey<N> ret;
+	mpn_to_bytes(ret.bytes.data() + 1, pubkey.Q[0], 32);
+	if (N == 33) {
+		// the low bit of y stands in for y until decompression
+		ret.bytes[0] = mpn_even_p(pubkey.Q[1], MP_NLIMBS(32)) ? 0x02 : 0x03;
+	}
+	else {
+		PublicKey decompressed = pubkey;
+		decompress_pubkey(decompressed);
+		ret.bytes[0] = 0x04;
+		mpn_to_bytes(ret.bytes.data() + 33, decompressed.Q[1], 32);
+	}
+	return ret;
+}
+
+template <size_t N>
+PublicKey deserialize_pubkey(const SerializedPublicKey<N> &pubkey) {
+	PublicKey ret;
+	bytes_to_mpn(ret.Q[0], pubkey.bytes.data() + 1, 32);
+	if (N == 33) {
+		mpn_zero(ret.Q[1], MP_NLIMBS(32)), ret.Q[1][0] = pubkey.bytes[0] & 1;
+		mpn_zero(ret.Q[2], MP_NLIMBS(32));
+	}
+	else {
+		bytes_to_mpn(ret.Q[1], pubkey.bytes.data() + 33, 32);
+		mpn_zero(ret.Q[2], MP_NLIMBS(32)), ret.Q[2][0] = 1;
+	}
+	ret.compress = N == 33;
+	return ret;
+}
+
+template Source & operator >> (Source &, CompressedPublicKey &);
+template Source & operator >> (Source &, UncompressedPublicKey &);
+template Sink & operator << (Sink &, const CompressedPublicKey &);
+template Sink & operator << (Sink &, const UncompressedPublicKey &);
+template CompressedPublicKey serialize_pubkey(const PublicKey &);
+template UncompressedPublicKey serialize_pubkey(const PublicKey &);
+template PublicKey deserialize_pubkey(const CompressedPublicKey &);
+template PublicKey deserialize_pubkey(const UncompressedPublicKey &);
+
+
+DecodeError try_decode_address(Address &address, const char str[], size_t n) noexcept {
+	size_t n_bytes = sizeof address;
+	if (n > base58check_max_length(sizeof address)) {
+		return DecodeError::INVALID_LENGTH;
+	}
+	auto error = base58check_decode_error(base58check_try_decode(&address, n_bytes, str, n));
+	if (error != DecodeError::OK) {
+		return error;
+	}
+	if (n_bytes != sizeof address) {
+		return DecodeError::INVALID_LENGTH;
+	}
+	switch (address.type) {
+		case Address::Type::PUBKEY_HASH:
+		case Address::Type::SCRIPT_HASH:
+		case Address::Type::TESTNET_PUBKEY_HASH:
+		case Address::Type::TESTNET_SCRIPT_HASH:
+			return DecodeError::OK;
+	}
+	return DecodeError::INVALID_TYPE;
+}
+
 Address decode_address(const char address[], size_t n) {
 	Address ret;
-	n = base58check_decode(&ret, sizeof ret, address, n);
-	if (n == sizeof ret && (ret.type == Address::Type::PUBKEY_HASH || ret.type == Address::Type::SCRIPT_HASH || ret.type == Address::Type::TESTNET_PUBKEY_HASH || ret.type == Address::Type::TESTNET_SCRIPT_HASH)) {
-		return ret;
+	auto error = try_decode_address(ret, address, n);
+	if (error != DecodeError::OK) {
+		throw_decode_error(error, "expected Bitcoin address");
 	}
-	throw std::ios_base::failure("expected Bitcoin address");
+	return ret;
+}
+
+size_t try_decode_addresses(Address addresses[], DecodeError errors[], const std::string strs[], size_t n) noexcept {
+	size_t n_valid = 0;
+	for (size_t i = 0; i < n; ++i) {
+		n_valid += (errors[i] = try_decode_address(addresses[i], strs[i].data(), strs[i].size())) == DecodeError::OK;
+	}
+	return n_valid;
 }
 
 std::string encode_address(const Address &address) {
 	return base58check_encode(&address, sizeof address);
 }
 
+void encode_addresses(std::string strs[], const Address addresses[], size_t n) {
+	char buf[64];
+	for (size_t i = 0; i < n; ++i) {
+		strs[i].assign(buf, base58check_encode(buf, sizeof buf, &addresses[i], sizeof *addresses));
+	}
+}
+
 std::istream & operator >> (std::istream &is, Address &address) {
 	std::string str;
 	is >> str;
@@ -181,11 +359,52 @@ std::ostream & operator << (std::ostream &os, const Address &address) {
 
 PublicKey privkey_to_pubkey(const PrivateKey &privkey) {
 	PublicKey ret;
-	ecp_pubkey(ret.Q, secp256k1_p, secp256k1_a, secp256k1_G, privkey.d);
+	JacobianPoint Q;
+	AffinePoint q;
+	point_mul_gen(Q, privkey.d);
+	point_to_affine(q, Q);
+	fe_get_mpn(ret.Q[0], q.x), fe_get_mpn(ret.Q[1], q.y);
+	mpn_zero(ret.Q[2], MP_NLIMBS(32)), ret.Q[2][0] = 1;
 	ret.compress = (privkey.flags & PrivateKey::Flags::COMPRESS) != PrivateKey::Flags::NONE;
 	return ret;
 }
 
+static void derive_keys(PublicKey pubkeys[], Address addresses[], const PrivateKey privkeys[], size_t n, bool testnet) {
+	std::unique_ptr<JacobianPoint[]> jacobian(new JacobianPoint[derivation_batch]);
+	std::unique_ptr<AffinePoint[]> affine(new AffinePoint[derivation_batch]);
+	std::unique_ptr<PublicKey[]> scratch(pubkeys ? nullptr : new PublicKey[derivation_batch]);
+	for (size_t begin = 0; begin < n; begin += derivation_batch) {
+		size_t m = std::min(n - begin, derivation_batch);
+		for (size_t i = 0; i < m; ++i) {
+			point_mul_gen(jacobian[i], privkeys[begin + i].d);
+		}
+		point_to_affine(affine.get(), jacobian.get(), m);
+		PublicKey *batch = pubkeys ? pubkeys + begin : scratch.get();
+		for (size_t i = 0; i < m; ++i) {
+			fe_get_mpn(batch[i].Q[0], affine[i].x), fe_get_mpn(batch[i].Q[1], affine[i].y);
+			mpn_zero(batch[i].Q[2], MP_NLIMBS(32)), batch[i].Q[2][0] = 1;
+			batch[i].compress = (privkeys[begin + i].flags & PrivateKey::Flags::COMPRESS) != PrivateKey::Flags::NONE;
+		}
+		if (addresses) {
+			pubkeys_to_addresses(addresses + begin, batch, m, testnet);
+		}
+	}
+}
+
+static void derive_keys(PublicKey pubkeys[], Address addresses[], const PrivateKey privkeys[], size_t n, bool testnet, unsigned n_threads) {
+	parallel_ranges(n, derivation_batch, n_threads, [&](size_t begin, size_t end) {
+		derive_keys(pubkeys ? pubkeys + begin : nullptr, addresses ? addresses + begin : nullptr, privkeys + begin, end - begin, testnet);
+	});
+}
+
+void privkeys_to_pubkeys(PublicKey pubkeys[], const PrivateKey privkeys[], size_t n, unsigned n_threads) {
+	derive_keys(pubkeys, nullptr, privkeys, n, false, n_threads);
+}
+
+void privkeys_to_addresses(Address addresses[], const PrivateKey privkeys[], size_t n, bool testnet, unsigned n_threads) {
+	derive_keys(nullptr, addresses, privkeys, n, testnet, n_threads);
+}
+
 Address pubkey_to_address(const PublicKey &pubkey, bool testnet) {
 	SHA256 sha;
 	sha << pubkey;
@@ -194,6 +413,18 @@ Address pubkey_to_address(const PublicKey &pubkey, bool testnet) {
 	return { testnet ? Address::Type::TESTNET_PUBKEY_HASH : Address::Type::PUBKEY_HASH, rmd.digest() };
 }
 
+template <size_t N>
+Address pubkey_to_address(const SerializedPublicKey<N> &pubkey, bool testnet) {
+	SHA256 sha;
+	sha << pubkey;
+	RIPEMD160 rmd;
+	rmd << sha.digest();
+	return { testnet ? Address::Type::TESTNET_PUBKEY_HASH : Address::Type::PUBKEY_HASH, rmd.digest() };
+}
+
+template Address pubkey_to_address(const CompressedPublicKey &, bool);
+template Address pubkey_to_address(const UncompressedPublicKey &, bool);
+
 Script address_to_script(const Address &address) {
 	Script txout_script;
 	switch (address.type) {
@@ -234,14 +465,9 @@ double compact_to_double(uint32_t compact) {
 }
 
 std::ostream & print_digest_le(std::ostream &os, const digest256_t &digest) {
-	auto orig_flags = os.flags(std::ios_base::hex | std::ios_base::right);
-	auto orig_fill = os.fill('0');
-	for (auto itr = digest.rbegin(); itr != digest.rend(); ++itr) {
-		os << std::setw(2) << static_cast<unsigned>(*itr);
-	}
-	os.fill(orig_fill);
-	os.flags(orig_flags);
-	return os;
+	char buf[64];
+	base16_encode_reversed(buf, digest.data(), digest.size());
+	return os.write(buf, sizeof buf);
 }
 
 std::ostream & operator << (std::ostream &os, std::chrono::system_clock::time_point time) {
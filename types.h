@@ -1,5 +1,8 @@
+#pragma once
+
 #include <array>
 #include <chrono>
+#include <cstring>
 #include <ostream>
 #include <vector>
 
@@ -12,10 +15,42 @@
 typedef std::array<uint8_t, 20> digest160_t;
 typedef std::array<uint8_t, 32> digest256_t;
 
+struct DigestHash {
+	uint64_t salt;
+	explicit DigestHash(uint64_t salt = 0) : salt(salt) { }
+	template <size_t N>
+	size_t operator () (const std::array<uint8_t, N> &digest) const {
+		uint64_t h = salt;
+		for (size_t i = 0; i + 8 <= N; i += 8) {
+			uint64_t w;
+			std::memcpy(&w, digest.data() + i, sizeof w);
+			h = (h ^ w) * UINT64_C(0x9E3779B97F4A7C15), h ^= h >> 32;
+		}
+		if (N % 8 != 0) {
+			uint64_t w = 0;
+			std::memcpy(&w, digest.data() + N / 8 * 8, N % 8);
+			h = (h ^ w) * UINT64_C(0x9E3779B97F4A7C15), h ^= h >> 32;
+		}
+		return static_cast<size_t>(h);
+	}
+};
+
 
 namespace satoshi {
 
 
+// reasons the try_decode_ functions give for rejecting their input
+enum class DecodeError : uint8_t {
+	OK,
+	INVALID_ENCODING,
+	INVALID_CHECKSUM,
+	INVALID_LENGTH,
+	INVALID_TYPE,
+};
+
+std::ostream & operator << (std::ostream &os, DecodeError error);
+
+
 struct PrivateKey {
 	mp_limb_t d[MP_NLIMBS(32)];
 	enum class Flags : uint8_t {
@@ -27,6 +62,7 @@ struct PrivateKey {
 DEFINE_ENUM_FLAG_OPS(PrivateKey::Flags)
 
 PrivateKey decode_privkey(const char privkey[], size_t n);
+DecodeError try_decode_privkey(PrivateKey &privkey, const char str[], size_t n) noexcept;
 std::string encode_privkey(const PrivateKey &privkey);
 std::istream & operator >> (std::istream &is, PrivateKey &privkey);
 std::ostream & operator << (std::ostream &os, const PrivateKey &privkey);
@@ -41,6 +77,7 @@ Source & operator >> (Source &source, PublicKey &pubkey);
 Sink & operator << (Sink &sink, const PublicKey &pubkey);
 
 PublicKey decode_pubkey(const char pubkey[], size_t n);
+DecodeError try_decode_pubkey(PublicKey &pubkey, const char str[], size_t n) noexcept;
 std::string encode_pubkey(const PublicKey &pubkey);
 std::istream & operator >> (std::istream &is, PublicKey &pubkey);
 std::ostream & operator << (std::ostream &os, const PublicKey &pubkey);
@@ -48,6 +85,36 @@ std::ostream & operator << (std::ostream &os, const PublicKey &pubkey);
 void decompress_pubkey(PublicKey &pubkey);
 
 
+// Public key kept as serialized, 33 bytes if compressed and 65 if not. It
+// compares and hashes as it is and yields its address without any elliptic
+// curve arithmetic, leaving PublicKey for when that is needed.
+template <size_t N>
+struct SerializedPublicKey {
+	static_assert(N == 33 || N == 65, "public keys serialize to 33 or 65 bytes");
+	std::array<uint8_t, N> bytes;
+
+	bool operator == (const SerializedPublicKey &other) const { return bytes == other.bytes; }
+	bool operator != (const SerializedPublicKey &other) const { return bytes != other.bytes; }
+	bool operator < (const SerializedPublicKey &other) const { return bytes < other.bytes; }
+};
+
+typedef SerializedPublicKey<33> CompressedPublicKey;
+typedef SerializedPublicKey<65> UncompressedPublicKey;
+
+struct PublicKeyHash : DigestHash {
+	explicit PublicKeyHash(uint64_t salt = 0) : DigestHash(salt) { }
+	template <size_t N>
+	size_t operator () (const SerializedPublicKey<N> &pubkey) const { return DigestHash::operator () (pubkey.bytes); }
+};
+
+template <size_t N> Source & operator >> (Source &source, SerializedPublicKey<N> &pubkey);
+template <size_t N> Sink & operator << (Sink &sink, const SerializedPublicKey<N> &pubkey);
+
+template <size_t N> SerializedPublicKey<N> serialize_pubkey(const PublicKey &pubkey);
+// a compressed key comes out not yet decompressed, as when read from a Source
+template <size_t N> PublicKey deserialize_pubkey(const SerializedPublicKey<N> &pubkey);
+
+
 struct Address {
 	enum class Type : uint8_t {
 		PUBKEY_HASH = 0,
@@ -59,6 +126,11 @@ struct Address {
 };
 
 Address decode_address(const char address[], size_t n);
+DecodeError try_decode_address(Address &address, const char str[], size_t n) noexcept;
+// Returns how many of the addresses were valid, and why each of the others
+// was not.
+size_t try_decode_addresses(Address addresses[], DecodeError errors[], const std::string strs[], size_t n) noexcept;
+void encode_addresses(std::string strs[], const Address addresses[], size_t n);
 std::string encode_address(const Address &address);
 std::istream & operator >> (std::istream &is, Address &address);
 std::ostream & operator << (std::ostream &os, const Address &address);
@@ -66,7 +138,16 @@ std::ostream & operator << (std::ostream &os, const Address &address);
 
 PublicKey privkey_to_pubkey(const PrivateKey &privkey);
 
+// Derive many keys at once, sharing one inversion among each few hundred and
+// spreading them over threads. Zero threads means one per hardware thread.
+void privkeys_to_pubkeys(PublicKey pubkeys[], const PrivateKey privkeys[], size_t n, unsigned n_threads = 0);
+void privkeys_to_addresses(Address addresses[], const PrivateKey privkeys[], size_t n, bool testnet = false, unsigned n_threads = 0);
+
+// keys per shared inversion when deriving many, and the fewest worth a thread
+static constexpr size_t derivation_batch = 256;
+
 Address pubkey_to_address(const PublicKey &pubkey, bool testnet = false);
+template <size_t N> Address pubkey_to_address(const SerializedPublicKey<N> &pubkey, bool testnet = false);
 
 Script address_to_script(const Address &address);
 
@@ -74,8 +155,8 @@ Script address_to_script(const Address &address);
 } // namespace satoshi
 
 
-template <typename T>
-static std::ostream & operator << (std::ostream &os, const std::vector<T> &vector) {
+template <typename T, typename A>
+static std::ostream & operator << (std::ostream &os, const std::vector<T, A> &vector) {
 	os << '[';
 	for (size_t i = 0; i < vector.size(); ++i) {
 		if (i > 0) {
@@ -0,0 +1,269 @@
+#include "validation.h"
+
+#include <ostream>
+#include <random>
+#include <unordered_map>
+
+#include "parallel.h"
+#include "sighash.h"
+
+
+namespace satoshi {
+
+
+static constexpr uint32_t lock_time_threshold = 500000000; // block heights are below, timestamps above
+static constexpr uint32_t sequence_disable_flag = UINT32_C(1) << 31;
+static constexpr uint32_t sequence_type_flag = UINT32_C(1) << 22;
+static constexpr uint32_t sequence_mask = 0x0000FFFF;
+
+// jobs a worker takes from its own range at a time
+static constexpr size_t grain = 8;
+
+// below this, hashing each input's serialization outright is cheaper
+static constexpr size_t sighash_cache_min_inputs = 4;
+
+// transactions hashed at a time when the txids are spread over threads
+static constexpr size_t txid_grain = 64;
+
+
+bool TxSignatureChecker::check_sig(Span<const uint8_t> sig, Span<const uint8_t> pubkey, Span<const uint8_t> script_code) const {
+	if (sig.empty() || !verifier) {
+		return false;
+	}
+	auto hash = sighashes ? sighashes->sighash(input, script_code, sig.back()) : legacy_sighash(tx, input, script_code, sig.back());
+	sig = sig.subspan(0, sig.size() - 1);
+	if (sigcache && sigcache->contains(hash, pubkey, sig)) {
+		return true;
+	}
+	if (!verifier(sig, pubkey, hash)) {
+		return false;
+	}
+	if (sigcache) {
+		sigcache->insert(hash, pubkey, sig);
+	}
+	return true;
+}
+
+bool TxSignatureChecker::check_lock_time(int64_t lock_time) const {
+	int64_t tx_lock_time = static_cast<uint32_t>(static_cast<int32_t>(tx.lock_time));
+	if ((tx_lock_time < lock_time_threshold) != (lock_time < lock_time_threshold)) {
+		return false;
+	}
+	return lock_time <= tx_lock_time && tx.inputs[input].seq_num != UINT32_MAX;
+}
+
+bool TxSignatureChecker::check_sequence(int64_t sequence) const {
+	uint32_t tx_sequence = tx.inputs[input].seq_num;
+	if (tx.version < 2 || tx_sequence & sequence_disable_flag) {
+		return false;
+	}
+	int64_t masked_tx_sequence = tx_sequence & (sequence_type_flag | sequence_mask), masked_sequence = sequence & (sequence_type_flag | sequence_mask);
+	if ((masked_tx_sequence < sequence_type_flag) != (masked_sequence < sequence_type_flag)) {
+		return false;
+	}
+	return masked_sequence <= masked_tx_sequence;
+}
+
+
+std::ostream & operator << (std::ostream &os, const ValidationResult &result) {
+	switch (result.status) {
+		case ValidationResult::Status::OK:
+			return os << "OK";
+		case ValidationResult::Status::MISSING_INPUT:
+			return os << "MISSING_INPUT at " << result.tx << ':' << result.input;
+		case ValidationResult::Status::SCRIPT_ERROR:
+			return os << result.error << " at " << result.tx << ':' << result.input;
+	}
+	return os;
+}
+
+
+BlockValidator::BlockValidator(unsigned n_threads, SignatureVerifier verifier, SignatureCache *sigcache) : verifier(verifier), sigcache(sigcache), txid_hasher(std::random_device()()), generation(), n_running(), stopping(), block(), flags(), first_failure(), failure_error() {
+	if (n_threads == 0 && (n_threads = std::thread::hardware_concurrency()) == 0) {
+		n_threads = 1;
+	}
+	workers.reserve(n_threads);
+	for (unsigned i = 0; i < n_threads; ++i) {
+		workers.emplace_back(new Worker);
+	}
+	// the calling thread is worker 0
+	threads.reserve(n_threads - 1);
+	for (unsigned i = 1; i < n_threads; ++i) {
+		threads.emplace_back(&BlockValidator::thread_main, this, i);
+	}
+}
+
+BlockValidator::~BlockValidator() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	start_cv.notify_all();
+	for (auto &thread : threads) {
+		thread.join();
+	}
+}
+
+ValidationResult BlockValidator::validate(const BlockMessage &block, const CoinView &coins, ScriptFlags flags) {
+	ValidationResult result { ValidationResult::Status::OK, ScriptError::OK, 0, 0 };
+	// Outputs created earlier in the same block are spendable. Gathering stops
+	// at the first input whose output cannot be found, but the inputs before it
+	// are still checked so that the earliest failure is the one reported.
+	// Only the txids are worked out ahead, and on all the threads; sighash
+	// caches are left to the jobs that use them.
+	txids.resize(block.txns.size());
+	parallel_ranges(block.txns.size(), txid_grain, static_cast<unsigned>(workers.size()), [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			txids[i] = tx_hash(block.txns[i]);
+		}
+	});
+	std::unordered_map<digest256_t, size_t, DigestHash> block_txns(block.txns.size(), txid_hasher);
+	jobs.clear();
+	sighash_caches.clear();
+	for (size_t tx_idx = 0; tx_idx < block.txns.size() && result; ++tx_idx) {
+		auto &tx = block.txns[tx_idx];
+		if (tx_idx > 0) { // the coinbase spends nothing
+			LazySighashCache *sighashes = nullptr;
+			if (tx.inputs.size() >= sighash_cache_min_inputs) {
+				sighash_caches.emplace_back();
+				sighashes = &sighash_caches.back();
+			}
+			for (size_t input = 0; input < tx.inputs.size(); ++input) {
+				auto &prevout = tx.inputs[input].prevout;
+				const TxOut *txout = nullptr;
+				auto itr = block_txns.find(prevout.tx_hash);
+				if (itr != block_txns.end()) {
+					auto &outputs = block.txns[itr->second].outputs;
+					if (prevout.txout_idx < outputs.size()) {
+						txout = &outputs[prevout.txout_idx];
+					}
+				}
+				else {
+					txout = coins.find(prevout);
+				}
+				if (!txout) {
+					result = { ValidationResult::Status::MISSING_INPUT, ScriptError::OK, tx_idx, input };
+					break;
+				}
+				jobs.push_back({ static_cast<uint32_t>(tx_idx), static_cast<uint32_t>(input), txout, sighashes });
+			}
+		}
+		block_txns.emplace(txids[tx_idx], tx_idx);
+	}
+
+	this->block = &block, this->flags = flags;
+	first_failure.store(SIZE_MAX, std::memory_order_relaxed);
+	size_t n_workers = workers.size();
+	for (size_t i = 0; i < n_workers; ++i) {
+		workers[i]->begin = jobs.size() * i / n_workers, workers[i]->end = jobs.size() * (i + 1) / n_workers;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		n_running = threads.size();
+		++generation;
+	}
+	start_cv.notify_all();
+	this->work(0);
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		done_cv.wait(lock, [this] { return n_running == 0; });
+	}
+	this->block = nullptr;
+	sighash_caches.clear();
+
+	size_t failed = first_failure.load(std::memory_order_relaxed);
+	if (failed != SIZE_MAX) {
+		result = { ValidationResult::Status::SCRIPT_ERROR, failure_error, jobs[failed].tx, jobs[failed].input };
+	}
+	return result;
+}
+
+void BlockValidator::thread_main(size_t self) {
+	uint64_t seen = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			start_cv.wait(lock, [&] { return stopping || generation != seen; });
+			if (stopping) {
+				return;
+			}
+			seen = generation;
+		}
+		this->work(self);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			--n_running;
+		}
+		done_cv.notify_one();
+	}
+}
+
+void BlockValidator::work(size_t self) {
+	auto &interp = workers[self]->interp;
+	size_t begin, end;
+	while (this->take(self, begin, end) || this->steal(self) && this->take(self, begin, end)) {
+		for (size_t i = begin; i < end; ++i) {
+			if (i > first_failure.load(std::memory_order_relaxed)) {
+				break;
+			}
+			auto &job = jobs[i];
+			auto &tx = block->txns[job.tx];
+			const SighashCache *sighashes = nullptr;
+			if (job.sighashes) {
+				auto &lazy = *job.sighashes;
+				std::call_once(lazy.built, [&] { lazy.cache.reset(new SighashCache(tx)); });
+				sighashes = lazy.cache.get();
+			}
+			TxSignatureChecker checker(tx, job.input, verifier, sighashes, sigcache);
+			auto error = interp.verify(tx.inputs[job.input].script, job.prevout->script, flags, checker);
+			if (error != ScriptError::OK) {
+				this->fail(i, error);
+			}
+		}
+	}
+	interp.clear();
+}
+
+bool BlockValidator::take(size_t self, size_t &begin, size_t &end) {
+	auto &worker = *workers[self];
+	std::lock_guard<std::mutex> lock(worker.mutex);
+	if (worker.begin == worker.end) {
+		return false;
+	}
+	begin = worker.begin, end = worker.end - begin > grain ? begin + grain : worker.end;
+	worker.begin = end;
+	return true;
+}
+
+bool BlockValidator::steal(size_t self) {
+	size_t n_workers = workers.size();
+	for (size_t i = 1; i < n_workers; ++i) {
+		auto &victim = *workers[(self + i) % n_workers];
+		size_t begin, end;
+		{
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			size_t n = victim.end - victim.begin;
+			if (n == 0) {
+				continue;
+			}
+			begin = victim.end - (n + 1) / 2, end = victim.end;
+			victim.end = begin;
+		}
+		auto &worker = *workers[self];
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		worker.begin = begin, worker.end = end;
+		return true;
+	}
+	return false;
+}
+
+void BlockValidator::fail(size_t job, ScriptError error) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (job < first_failure.load(std::memory_order_relaxed)) {
+		failure_error = error;
+		first_failure.store(job, std::memory_order_relaxed);
+	}
+}
+
+
+} // namespace satoshi
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "blockchain.h"
+#include "ecdsa.h"
+#include "interpreter.h"
+#include "satoshi.h"
+#include "sigcache.h"
+#include "sighash.h"
+
+
+namespace satoshi {
+
+
+// Verifies a DER-encoded signature, without its sighash type byte, of a
+// message hash by a serialized public key.
+typedef bool (*SignatureVerifier)(Span<const uint8_t> sig, Span<const uint8_t> pubkey, const digest256_t &hash);
+
+
+// Checks signatures and lock times against input `input` of `tx`. Signature
+// hashes come from `sighashes` if given, which must have been built from `tx`.
+// Signatures found in `sigcache` are not verified again, and those verified
+// are added to it.
+class TxSignatureChecker : public SignatureChecker {
+
+private:
+	const Tx &tx;
+	size_t input;
+	SignatureVerifier verifier;
+	const SighashCache *sighashes;
+	SignatureCache *sigcache;
+
+public:
+	TxSignatureChecker(const Tx &tx, size_t input, SignatureVerifier verifier, const SighashCache *sighashes = nullptr, SignatureCache *sigcache = nullptr) :
+			tx(tx), input(input), verifier(verifier), sighashes(sighashes), sigcache(sigcache) { }
+
+public:
+	bool check_sig(Span<const uint8_t> sig, Span<const uint8_t> pubkey, Span<const uint8_t> script_code) const override;
+	bool check_lock_time(int64_t lock_time) const override;
+	bool check_sequence(int64_t sequence) const override;
+
+};
+
+
+// Source of the outputs that a block's inputs spend.
+class CoinView {
+
+public:
+	virtual ~CoinView() { }
+
+public:
+	// Returns null if the output does not exist or is already spent.
+	virtual const TxOut * find(const OutPoint &outpoint) const = 0;
+
+};
+
+
+struct ValidationResult {
+	enum class Status : uint8_t {
+		OK,
+		MISSING_INPUT,
+		SCRIPT_ERROR,
+	} status;
+	ScriptError error;
+	// location of the first failure in block order
+	size_t tx, input;
+
+	explicit operator bool () const { return status == Status::OK; }
+};
+
+std::ostream & operator << (std::ostream &os, const ValidationResult &result);
+
+
+// Verifies the scripts of every input of a block on a pool of threads. Each
+// thread owns a range of inputs and steals half of another thread's range
+// when its own runs out. Inputs after the earliest failure seen so far are
+// skipped, yet every input before it is still checked, so the result is the
+// first failure in block order whatever the number of threads.
+class BlockValidator {
+
+private:
+	// built by whichever job of its transaction first needs it
+	struct LazySighashCache {
+		std::once_flag built;
+		std::unique_ptr<SighashCache> cache;
+	};
+
+	struct Job {
+		uint32_t tx, input;
+		const TxOut *prevout;
+		LazySighashCache *sighashes;
+	};
+
+	struct Worker {
+		std::mutex mutex;
+		size_t begin, end; // range of jobs not yet taken
+		Interpreter interp;
+		Worker() : begin(), end() { }
+	};
+
+private:
+	SignatureVerifier verifier;
+	SignatureCache *sigcache;
+	DigestHash txid_hasher; // salted, so that txids cannot be ground into one bucket
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable start_cv, done_cv;
+	uint64_t generation;
+	size_t n_running;
+	bool stopping;
+
+	// the batch being validated
+	const BlockMessage *block;
+	std::vector<digest256_t> txids;
+	std::vector<Job> jobs;
+	std::deque<LazySighashCache> sighash_caches;
+	ScriptFlags flags;
+	std::atomic<size_t> first_failure;
+	ScriptError failure_error;
+
+public:
+	// zero threads means one per hardware thread
+	explicit BlockValidator(unsigned n_threads = 0, SignatureVerifier verifier = &verify_signature, SignatureCache *sigcache = nullptr);
+	~BlockValidator();
+
+	BlockValidator(const BlockValidator &) = delete;
+	BlockValidator & operator = (const BlockValidator &) = delete;
+
+public:
+	ValidationResult validate(const BlockMessage &block, const CoinView &coins, ScriptFlags flags);
+
+private:
+	void thread_main(size_t self);
+	void work(size_t self);
+	bool take(size_t self, size_t &begin, size_t &end);
+	bool steal(size_t self);
+	void fail(size_t job, ScriptError error);
+
+};
+
+
+} // namespace satoshi
@@ -0,0 +1,133 @@
+#include "watch.h"
+
+#include <cstring>
+#include <random>
+#include <stdexcept>
+
+#include "parallel.h"
+
+
+namespace satoshi {
+
+
+struct WatchScanner::BlockScan {
+	std::vector<WatchEvent> funds, spends;
+	std::vector<std::pair<OutPoint, Coin>> coins; // found in the block
+};
+
+static ScriptType _const address_script_type(Address::Type type) {
+	return type == Address::Type::PUBKEY_HASH || type == Address::Type::TESTNET_PUBKEY_HASH ? ScriptType::PUBKEYHASH : ScriptType::SCRIPTHASH;
+}
+
+
+WatchScanner::WatchScanner(const Address addresses[], size_t n) : addresses(addresses, addresses + n), hasher(std::random_device()()), coins(0, OutPointHash(std::random_device()())) {
+	if (n >= empty_slot) {
+		throw std::length_error("watch list is too large");
+	}
+	size_t n_slots = 16;
+	while (n_slots < n * 2) {
+		n_slots *= 2;
+	}
+	slots.assign(n_slots, Slot { 0, empty_slot });
+	for (size_t i = 0; i < n; ++i) {
+		ScriptMatch match;
+		match.type = address_script_type(addresses[i].type);
+		match.data = Span<const uint8_t>(addresses[i].hash.data(), addresses[i].hash.size());
+		if (this->find(match) != empty_slot) {
+			continue; // listed twice, and found by its first position
+		}
+		uint64_t h = hasher(addresses[i].hash);
+		size_t j = h & n_slots - 1;
+		while (slots[j].address != empty_slot) {
+			j = j + 1 & n_slots - 1;
+		}
+		slots[j] = { static_cast<uint32_t>(h >> 32), static_cast<uint32_t>(i) };
+	}
+}
+
+void WatchScanner::scan(std::vector<WatchEvent> &events, const BlockMessage blocks[], size_t n_blocks, unsigned n_threads) {
+	// Outputs are scanned first, as a block may spend what any block before
+	// it paid. Inputs need only be scanned if anything was ever found.
+	std::vector<BlockScan> scans(n_blocks);
+	// blocks are handed out one at a time, as their sizes vary widely
+	parallel_ranges(n_blocks, 1, n_threads, [&](size_t i, size_t) { this->scan_outputs(scans[i], blocks[i], i); });
+	for (auto &scan : scans) {
+		coins.insert(scan.coins.begin(), scan.coins.end());
+	}
+	if (!coins.empty()) {
+		parallel_ranges(n_blocks, 1, n_threads, [&](size_t i, size_t) { this->scan_inputs(scans[i], blocks[i], i); });
+	}
+	// within a transaction, its inputs come before its outputs
+	for (auto &scan : scans) {
+		auto fund = scan.funds.begin(), spend = scan.spends.begin();
+		while (fund != scan.funds.end() || spend != scan.spends.end()) {
+			if (spend != scan.spends.end() && (fund == scan.funds.end() || spend->tx <= fund->tx)) {
+				auto &input = blocks[spend->block].txns[spend->tx].inputs[spend->index];
+				coins.erase(input.prevout);
+				events.push_back(*spend++);
+			}
+			else {
+				events.push_back(*fund++);
+			}
+		}
+	}
+}
+
+uint32_t WatchScanner::find(const ScriptMatch &match) const {
+	if (match.type != ScriptType::PUBKEYHASH && match.type != ScriptType::SCRIPTHASH) {
+		return empty_slot;
+	}
+	digest160_t hash;
+	std::memcpy(hash.data(), match.data.data(), hash.size());
+	uint64_t h = hasher(hash);
+	auto tag = static_cast<uint32_t>(h >> 32);
+	for (size_t mask = slots.size() - 1, i = h & mask;; i = i + 1 & mask) {
+		auto slot = slots[i];
+		if (slot.address == empty_slot) {
+			return empty_slot;
+		}
+		if (slot.tag == tag) {
+			auto &address = addresses[slot.address];
+			if (address.hash == hash && address_script_type(address.type) == match.type) {
+				return slot.address;
+			}
+		}
+	}
+}
+
+void WatchScanner::scan_outputs(BlockScan &scan, const BlockMessage &block, size_t block_idx) const {
+	for (size_t tx_idx = 0; tx_idx < block.txns.size(); ++tx_idx) {
+		auto &tx = block.txns[tx_idx];
+		OutPoint outpoint;
+		bool hashed = false;
+		for (size_t output = 0; output < tx.outputs.size(); ++output) {
+			auto &txout = tx.outputs[output];
+			uint32_t address = this->find(classify_script(txout.script));
+			if (address == empty_slot) {
+				continue;
+			}
+			// only transactions that pay the list are hashed
+			if (!hashed) {
+				outpoint.tx_hash = tx_hash(tx), hashed = true;
+			}
+			outpoint.txout_idx = static_cast<uint32_t>(output);
+			scan.funds.push_back({ block_idx, static_cast<uint32_t>(tx_idx), static_cast<uint32_t>(output), false, address, txout.amount });
+			scan.coins.emplace_back(outpoint, Coin { address, txout.amount });
+		}
+	}
+}
+
+void WatchScanner::scan_inputs(BlockScan &scan, const BlockMessage &block, size_t block_idx) const {
+	for (size_t tx_idx = 1; tx_idx < block.txns.size(); ++tx_idx) {
+		auto &inputs = block.txns[tx_idx].inputs;
+		for (size_t input = 0; input < inputs.size(); ++input) {
+			auto itr = coins.find(inputs[input].prevout);
+			if (itr != coins.end()) {
+				scan.spends.push_back({ block_idx, static_cast<uint32_t>(tx_idx), static_cast<uint32_t>(input), true, itr->second.address, itr->second.amount });
+			}
+		}
+	}
+}
+
+
+} // namespace satoshi
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "blockchain.h"
+#include "standard.h"
+
+
+namespace satoshi {
+
+
+struct WatchEvent {
+	size_t block; // position among the blocks scanned together
+	uint32_t tx; // position in the block
+	uint32_t index; // of the output, or of the input for a spend
+	bool spend; // of an output found earlier
+	uint32_t address; // position in the watch list
+	uint64_t amount;
+};
+
+
+// Finds the outputs paying a list of P2PKH and P2SH addresses, and the inputs
+// spending those outputs. The list is compiled into an open-addressed table of
+// 32-bit tags and list positions, half full at most, which for tens of
+// thousands of addresses fits in cache; only a tag match compares the hash
+// itself. Outputs found are remembered until they are spent, also across
+// calls to scan(), so blocks must be scanned in chain order.
+class WatchScanner {
+
+private:
+	struct Slot {
+		uint32_t tag, address; // address is empty_slot if the slot is
+	};
+
+	struct Coin {
+		uint32_t address;
+		uint64_t amount;
+	};
+
+	struct OutPointHash : DigestHash {
+		explicit OutPointHash(uint64_t salt = 0) : DigestHash(salt) { }
+		size_t operator () (const OutPoint &outpoint) const { return DigestHash::operator () (outpoint.tx_hash) ^ outpoint.txout_idx; }
+	};
+
+	struct OutPointEqual {
+		bool operator () (const OutPoint &lhs, const OutPoint &rhs) const { return lhs.tx_hash == rhs.tx_hash && lhs.txout_idx == rhs.txout_idx; }
+	};
+
+	struct BlockScan;
+
+	static constexpr uint32_t empty_slot = UINT32_MAX;
+
+private:
+	std::vector<Address> addresses;
+	std::vector<Slot> slots;
+	DigestHash hasher;
+	std::unordered_map<OutPoint, Coin, OutPointHash, OutPointEqual> coins;
+
+public:
+	WatchScanner(const Address addresses[], size_t n);
+
+public:
+	size_t size() const { return addresses.size(); }
+	// outputs found and not yet spent
+	size_t coin_count() const { return coins.size(); }
+
+	// Appends the events of the blocks in chain order. The blocks are spread
+	// over threads, zero meaning one per hardware thread.
+	void scan(std::vector<WatchEvent> &events, const BlockMessage blocks[], size_t n_blocks, unsigned n_threads = 0);
+
+private:
+	uint32_t find(const ScriptMatch &match) const _pure;
+	void scan_outputs(BlockScan &scan, const BlockMessage &block, size_t block_idx) const;
+	void scan_inputs(BlockScan &scan, const BlockMessage &block, size_t block_idx) const;
+
+};
+
+
+} // namespace satoshi